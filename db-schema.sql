@@ -4,18 +4,50 @@ drop table if exists public.daily_graph;
 
 -- Status graph data
 
+-- Values are stored as real, fixed size and much more compact than numeric
+-- which matters when sampling at a high rate. To convert an existing table:
+--
+-- alter table public.daily_graph
+--	alter column soc type real, alter column batterij type real,
+--	alter column verbruik type real, alter column levering type real,
+--	alter column opwekking type real;
+-- create index daily_graph_tijd_ix on public.daily_graph (tijd);
+--
+-- Each sample holds the mean power over the interval, the minimum and
+-- maximum seen and the energy in Wh. To add these to an existing table:
+--
+-- alter table public.daily_graph
+--	add column opwekking_min real, add column opwekking_max real, add column opwekking_wh real,
+--	add column batterij_min real, add column batterij_max real, add column batterij_wh real,
+--	add column verbruik_min real, add column verbruik_max real, add column verbruik_wh real,
+--	add column levering_min real, add column levering_max real, add column levering_wh real;
+
 create table
 	public.daily_graph (
 		tijd timestamp without time zone default now() not null,
-		soc numeric(3, 2),
-		batterij numeric(4),
-		verbruik numeric(4),
-		levering numeric(4),
-		opwekking numeric(4)
+		soc real,
+		batterij real,
+		verbruik real,
+		levering real,
+		opwekking real,
+		opwekking_min real,
+		opwekking_max real,
+		opwekking_wh real,
+		batterij_min real,
+		batterij_max real,
+		batterij_wh real,
+		verbruik_min real,
+		verbruik_max real,
+		verbruik_wh real,
+		levering_min real,
+		levering_max real,
+		levering_wh real
 	);
 
 alter table public.daily_graph owner to "energie-admin";
 
+create index daily_graph_tijd_ix on public.daily_graph (tijd);
+
 -- Tables for the history of energy usage
 
 drop table if exists public.opname cascade;
@@ -28,6 +60,15 @@ create table public.opname (
 alter table public.opname owner to "energie-admin";
 comment on table public.opname is 'een opname van meerdere tellerstanden';
 
+-- The opnames are listed a page at a time, newest first, ordered by tijd
+-- and id. To add the indices to an existing database:
+--
+-- drop index if exists opname_tijd_ix;
+-- create index opname_tijd_ix on public.opname (tijd, id);
+-- create index tellerstand_opname_ix on public.tellerstand (opname_id);
+
+create index opname_tijd_ix on public.opname (tijd, id);
+
 create table public.teller (
     id serial primary key,
     naam character varying(32) not null,
@@ -39,6 +80,19 @@ create table public.teller (
 alter table public.teller owner to "energie-admin";
 comment on table public.teller is 'de verschillende tellers';
 
+-- energyd caches the tellers, this tells it to reload them
+
+create or replace function public.teller_gewijzigd() returns trigger
+    language plpgsql as $$
+begin
+    perform pg_notify('teller_gewijzigd', '');
+    return null;
+end;
+$$;
+
+create trigger teller_gewijzigd after insert or update or delete or truncate on public.teller
+    for each statement execute function public.teller_gewijzigd();
+
 create table public.tellerstand (
     id serial primary key,
     teller_id integer references public.teller,
@@ -49,6 +103,8 @@ create table public.tellerstand (
 alter table public.tellerstand owner to "energie-admin";
 comment on table public.tellerstand is 'de stand van een teller';
 
+create index tellerstand_opname_ix on public.tellerstand (opname_id);
+
 -- some data
 
 copy public.teller (id, naam, naam_kort, schaal, teken) from stdin;
@@ -0,0 +1,99 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+// --------------------------------------------------------------------
+// Summary of a quantity over one sample interval
+
+struct IntervalWaarde
+{
+	float gem;
+	float min;
+	float max;
+	float wh;
+};
+
+// --------------------------------------------------------------------
+// Integrates readings over time. Each reading is held until the next
+// one arrives, so the energy is the area under that step function.
+// Adding a reading is O(1), take() closes the interval and starts a
+// new one that continues with the last reading.
+
+class IntervalAccumulator
+{
+  public:
+	void add(std::chrono::system_clock::time_point t, float v)
+	{
+		if (not m_has_value)
+		{
+			m_has_value = true;
+			m_begin = t;
+			m_min = m_max = v;
+		}
+		else if (t > m_last_t)
+			m_integraal += m_last_v * std::chrono::duration<double>(t - m_last_t).count();
+
+		m_last_t = t;
+		m_last_v = v;
+
+		m_min = std::min(m_min, v);
+		m_max = std::max(m_max, v);
+	}
+
+	IntervalWaarde take(std::chrono::system_clock::time_point t)
+	{
+		if (not m_has_value)
+			return {};
+
+		if (t > m_last_t)
+			m_integraal += m_last_v * std::chrono::duration<double>(t - m_last_t).count();
+
+		double duur = std::chrono::duration<double>(t - m_begin).count();
+
+		IntervalWaarde result{
+			.gem = static_cast<float>(duur > 0 ? m_integraal / duur : m_last_v),
+			.min = m_min,
+			.max = m_max,
+			.wh = static_cast<float>(m_integraal / 3600)
+		};
+
+		m_begin = m_last_t = t;
+		m_integraal = 0;
+		m_min = m_max = m_last_v;
+
+		return result;
+	}
+
+  private:
+	bool m_has_value = false;
+	std::chrono::system_clock::time_point m_begin, m_last_t;
+	float m_last_v = 0, m_min = 0, m_max = 0;
+	double m_integraal = 0;
+};
@@ -0,0 +1,385 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gorilla.hpp"
+#include "grafiek-opslag.hpp"
+
+#include <date/date.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <system_error>
+
+// --------------------------------------------------------------------
+
+namespace
+{
+
+const uint32_t kSegmentMagic = 0x31465247; // "GRF1"
+
+struct BlokKop
+{
+	uint32_t magic;
+	uint16_t kolommen;
+	uint16_t reserved;
+	uint32_t aantal;
+	uint32_t lengte;
+};
+
+static_assert(sizeof(BlokKop) == 16);
+
+// Samples per block, bounds the loss when a block is damaged
+constexpr uint32_t kMaxBlok = 4096;
+
+// Reads the header at offset, returns false if there is none
+bool lees_kop(const uint8_t *data, size_t size, size_t offset, BlokKop &kop)
+{
+	if (offset + sizeof(BlokKop) > size)
+		return false;
+
+	std::memcpy(&kop, data + offset, sizeof(kop));
+
+	return kop.magic == kSegmentMagic and kop.kolommen > 0 and kop.kolommen <= 64 and kop.reserved == 0;
+}
+
+// The offset of the next block header after offset, or size if there is none
+size_t zoek_kop(const uint8_t *data, size_t size, size_t offset)
+{
+	BlokKop kop;
+
+	for (++offset; offset + sizeof(BlokKop) <= size; ++offset)
+	{
+		if (lees_kop(data, size, offset, kop))
+			return offset;
+	}
+
+	return size;
+}
+
+std::filesystem::path segment_naam(const std::filesystem::path &map, date::sys_days dag)
+{
+	return map / (date::format("%F", dag) + ".seg");
+}
+
+// --------------------------------------------------------------------
+// Read only mapping of a segment file, empty if the file does not exist
+
+class Segment
+{
+  public:
+	Segment(const std::filesystem::path &p)
+	{
+		int fd = ::open(p.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 and st.st_size > 0)
+		{
+			void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m != MAP_FAILED)
+			{
+				madvise(m, st.st_size, MADV_SEQUENTIAL);
+
+				m_data = static_cast<const uint8_t *>(m);
+				m_size = st.st_size;
+			}
+		}
+
+		close(fd);
+	}
+
+	~Segment()
+	{
+		if (m_data)
+			munmap(const_cast<uint8_t *>(m_data), m_size);
+	}
+
+	Segment(const Segment &) = delete;
+	Segment &operator=(const Segment &) = delete;
+
+	const uint8_t *data() const
+	{
+		return m_data;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+  private:
+	const uint8_t *m_data = nullptr;
+	size_t m_size = 0;
+};
+
+// --------------------------------------------------------------------
+
+class BestandLezer : public GrafiekLezer
+{
+  public:
+	BestandLezer(const std::filesystem::path &map, GrafiekOpslag::time_point van, GrafiekOpslag::time_point tot)
+		: m_map(map)
+		, m_van(van)
+		, m_tot(tot)
+		, m_dag(date::floor<date::days>(van))
+	{
+		if (tot == GrafiekOpslag::time_point::max())
+			m_laatste_dag = date::floor<date::days>(std::chrono::system_clock::now()) + date::days{ 1 };
+		else
+			m_laatste_dag = date::floor<date::days>(tot);
+	}
+
+	bool volgende(GrafiekPunt &pt) override
+	{
+		for (;;)
+		{
+			int64_t t;
+			if (m_decoder and m_decoder->next(t, m_waarden.data()))
+			{
+				GrafiekOpslag::time_point tijd{ std::chrono::seconds{ t } };
+
+				if (tijd < m_van)
+					continue;
+
+				// blocks are written in chronological order
+				if (tijd >= m_tot)
+					return false;
+
+				pt = { .tijd = tijd };
+
+				for (size_t k = 0; k < kAantalGrafiekVelden and k < m_waarden.size(); ++k)
+					pt.*kGrafiekVelden[k].veld = m_waarden[k];
+
+				return true;
+			}
+
+			if (not volgend_blok())
+				return false;
+		}
+	}
+
+  private:
+	bool volgend_blok()
+	{
+		m_decoder.reset();
+
+		for (;;)
+		{
+			if (m_segment and m_offset + sizeof(BlokKop) <= m_segment->size())
+			{
+				auto data = m_segment->data();
+				auto size = m_segment->size();
+
+				BlokKop kop;
+				if (not lees_kop(data, size, m_offset, kop))
+				{
+					// damaged, continue at the next block
+					m_offset = zoek_kop(data, size, m_offset);
+					continue;
+				}
+
+				// The block may have grown after the file was mapped, or
+				// was cut short. The decoder stops at the end of the data.
+				size_t lengte = std::min<size_t>(kop.lengte, size - m_offset - sizeof(kop));
+
+				m_waarden.assign(kop.kolommen, 0);
+				m_decoder.emplace(data + m_offset + sizeof(kop), lengte, kop.kolommen, kop.aantal);
+				m_offset += sizeof(kop) + lengte;
+
+				return true;
+			}
+
+			if (m_dag > m_laatste_dag)
+				return false;
+
+			m_segment = std::make_unique<Segment>(segment_naam(m_map, m_dag));
+			m_offset = 0;
+			m_dag += date::days{ 1 };
+		}
+	}
+
+	std::filesystem::path m_map;
+	GrafiekOpslag::time_point m_van, m_tot;
+	date::sys_days m_dag, m_laatste_dag;
+
+	std::unique_ptr<Segment> m_segment;
+	size_t m_offset = 0;
+
+	std::optional<GorillaDecoder> m_decoder;
+	std::vector<float> m_waarden;
+};
+
+// The offset for a new block in a segment file: its end. A block that
+// was only partly written stays in front of it, readers skip it. The
+// file is never made shorter, a reader may have it mapped.
+size_t einde_segment(const std::filesystem::path &path)
+{
+	struct stat st;
+	if (::stat(path.c_str(), &st) != 0)
+	{
+		if (errno == ENOENT)
+			return 0;
+
+		throw std::system_error(errno, std::generic_category(), "Failed to access segment file " + path.string());
+	}
+
+	return st.st_size;
+}
+
+// Write all of data at offset
+void schrijf_op(int fd, const void *data, size_t lengte, size_t offset, const std::filesystem::path &path)
+{
+	auto p = static_cast<const char *>(data);
+
+	while (lengte > 0)
+	{
+		auto n = ::pwrite(fd, p, lengte, offset);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			throw std::system_error(errno, std::generic_category(), "Failed to write to segment file " + path.string());
+		}
+
+		p += n;
+		lengte -= n;
+		offset += n;
+	}
+}
+
+} // namespace
+
+// --------------------------------------------------------------------
+
+struct BestandOpslag::Staart
+{
+	date::sys_days dag;
+	size_t offset;
+	GorillaEncoder encoder{ kAantalGrafiekVelden };
+};
+
+BestandOpslag::BestandOpslag(const std::filesystem::path &map)
+	: m_map(map)
+{
+	std::filesystem::create_directories(m_map);
+}
+
+BestandOpslag::~BestandOpslag() = default;
+
+void BestandOpslag::schrijf(const std::vector<GrafiekPunt> &batch)
+{
+	std::unique_lock lock(m_mutex);
+
+	for (auto b = batch.begin(); b != batch.end();)
+	{
+		auto dag = date::floor<date::days>(b->tijd);
+		auto path = segment_naam(m_map, dag);
+
+		if (not m_staart or m_staart->dag != dag)
+		{
+			// The first block of this day since starting, or since an
+			// error. It starts after whatever the file contains.
+			m_staart.reset(new Staart{ dag, einde_segment(path) });
+		}
+		else if (m_staart->encoder.size() >= kMaxBlok)
+			m_staart.reset(new Staart{ dag, m_staart->offset + sizeof(BlokKop) + m_staart->encoder.data().size() });
+
+		auto &encoder = m_staart->encoder;
+		size_t oud = encoder.data().size();
+
+		float waarden[kAantalGrafiekVelden];
+
+		auto e = b;
+		for (; e != batch.end() and date::floor<date::days>(e->tijd) == dag and encoder.size() < kMaxBlok; ++e)
+		{
+			for (size_t k = 0; k < kAantalGrafiekVelden; ++k)
+				waarden[k] = (*e).*kGrafiekVelden[k].veld;
+
+			encoder.add(date::floor<std::chrono::seconds>(e->tijd).time_since_epoch().count(), waarden);
+		}
+
+		b = e;
+
+		BlokKop kop{
+			.magic = kSegmentMagic,
+			.kolommen = static_cast<uint16_t>(kAantalGrafiekVelden),
+			.reserved = 0,
+			.aantal = static_cast<uint32_t>(encoder.size()),
+			.lengte = static_cast<uint32_t>(encoder.data().size())
+		};
+
+		// Encoded bits are only appended, of the data already written only
+		// the last byte can change. That part is written first and the
+		// header last, until then readers see the block as it was.
+		size_t van = oud > 0 ? oud - 1 : 0;
+
+		int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+		if (fd < 0)
+		{
+			m_staart.reset();
+			throw std::system_error(errno, std::generic_category(), "Failed to open segment file " + path.string());
+		}
+
+		try
+		{
+			schrijf_op(fd, encoder.data().data() + van, kop.lengte - van, m_staart->offset + sizeof(kop) + van, path);
+			schrijf_op(fd, &kop, sizeof(kop), m_staart->offset, path);
+		}
+		catch (...)
+		{
+			::close(fd);
+
+			// the file is checked again on the next write
+			m_staart.reset();
+			throw;
+		}
+
+		::close(fd);
+	}
+}
+
+void BestandOpslag::lees(time_point van, time_point tot, std::function<void(const GrafiekPunt &)> &&cb)
+{
+	auto lezer = open(van, tot);
+
+	GrafiekPunt pt;
+	while (lezer->volgende(pt))
+		cb(pt);
+}
+
+std::unique_ptr<GrafiekLezer> BestandOpslag::open(time_point van, time_point tot)
+{
+	return std::make_unique<BestandLezer>(m_map, van, tot);
+}
@@ -0,0 +1,167 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "compressie.hpp"
+
+#include <zlib.h>
+
+#include <stdexcept>
+
+// --------------------------------------------------------------------
+
+float q_waarde(std::string_view accept_encoding, std::string_view coding)
+{
+	float result = 0;
+
+	while (not accept_encoding.empty())
+	{
+		auto e = accept_encoding.find(',');
+		auto item = accept_encoding.substr(0, e);
+		accept_encoding = e == std::string_view::npos ? std::string_view{} : accept_encoding.substr(e + 1);
+
+		while (not item.empty() and item.front() == ' ')
+			item.remove_prefix(1);
+
+		auto s = item.find(';');
+		auto naam = item.substr(0, s);
+		while (not naam.empty() and naam.back() == ' ')
+			naam.remove_suffix(1);
+
+		if (naam != coding and naam != "*")
+			continue;
+
+		float q = 1;
+		if (s != std::string_view::npos)
+		{
+			auto p = item.find("q=", s);
+			if (p != std::string_view::npos)
+				q = std::strtof(std::string{ item.substr(p + 2) }.c_str(), nullptr);
+		}
+
+		// an explicit entry overrides the wildcard
+		if (naam == coding)
+			return q;
+
+		result = q;
+	}
+
+	return result;
+}
+
+Codering kies_codering(std::string_view accept_encoding)
+{
+	auto gzip = q_waarde(accept_encoding, "gzip");
+	auto deflate = q_waarde(accept_encoding, "deflate");
+
+	if (gzip > 0 and gzip >= deflate)
+		return Codering::gzip;
+
+	if (deflate > 0)
+		return Codering::deflate;
+
+	return Codering::geen;
+}
+
+const char *codering_naam(Codering codering)
+{
+	switch (codering)
+	{
+		case Codering::gzip: return "gzip";
+		case Codering::deflate: return "deflate";
+		default: return "identity";
+	}
+}
+
+std::string comprimeer(std::string_view data, Codering codering)
+{
+	z_stream z{};
+
+	// window bits 15 gives a zlib stream, which is what deflate means in HTTP,
+	// adding 16 gives a gzip stream
+	if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, codering == Codering::gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw std::runtime_error("deflateInit2 failed");
+
+	std::string result(deflateBound(&z, data.size()), 0);
+
+	z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+	z.avail_in = static_cast<uInt>(data.size());
+	z.next_out = reinterpret_cast<Bytef *>(result.data());
+	z.avail_out = static_cast<uInt>(result.size());
+
+	auto err = deflate(&z, Z_FINISH);
+	result.resize(z.total_out);
+	deflateEnd(&z);
+
+	if (err != Z_STREAM_END)
+		throw std::runtime_error("deflate failed");
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+std::unique_ptr<CompressieCache> CompressieCache::s_instance;
+
+CompressieCache &CompressieCache::instance()
+{
+	static std::once_flag s_once;
+	std::call_once(s_once, []()
+		{ s_instance.reset(new CompressieCache); });
+	return *s_instance;
+}
+
+std::shared_ptr<const std::string> CompressieCache::get(const std::string &etag, Codering codering, std::string_view data)
+{
+	key_type key{ etag, codering };
+
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (auto i = m_cache.find(key); i != m_cache.end())
+		{
+			m_lru.splice(m_lru.begin(), m_lru, i->second.lru);
+			return i->second.data;
+		}
+	}
+
+	auto result = std::make_shared<const std::string>(comprimeer(data, codering));
+
+	std::unique_lock lock(m_mutex);
+
+	if (m_cache.count(key) == 0)
+	{
+		m_lru.push_front(key);
+		m_cache.emplace(key, entry{ result, m_lru.begin() });
+
+		while (m_cache.size() > kMaxSize)
+		{
+			m_cache.erase(m_lru.back());
+			m_lru.pop_back();
+		}
+	}
+
+	return result;
+}
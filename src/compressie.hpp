@@ -0,0 +1,86 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+// --------------------------------------------------------------------
+// Compression of HTTP replies using zlib
+
+enum class Codering
+{
+	geen,
+	gzip,
+	deflate
+};
+
+// Returns the q value for coding in an Accept-Encoding header, 0 if absent
+float q_waarde(std::string_view accept_encoding, std::string_view coding);
+
+// The preferred encoding the client accepts, based on Accept-Encoding
+Codering kies_codering(std::string_view accept_encoding);
+
+const char *codering_naam(Codering codering);
+
+std::string comprimeer(std::string_view data, Codering codering);
+
+// --------------------------------------------------------------------
+// Compressed replies that carry an ETag do not change, so the
+// compressed bytes are kept in a small LRU cache keyed by ETag.
+
+class CompressieCache
+{
+  public:
+	static CompressieCache &instance();
+
+	std::shared_ptr<const std::string> get(const std::string &etag, Codering codering, std::string_view data);
+
+  private:
+	CompressieCache() = default;
+
+	using key_type = std::tuple<std::string, Codering>;
+	using lru_list = std::list<key_type>;
+
+	struct entry
+	{
+		std::shared_ptr<const std::string> data;
+		lru_list::iterator lru;
+	};
+
+	std::mutex m_mutex;
+	std::map<key_type, entry> m_cache;
+	lru_list m_lru;
+	static constexpr size_t kMaxSize = 64;
+
+	static std::unique_ptr<CompressieCache> s_instance;
+};
@@ -0,0 +1,202 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "connection-pool.hpp"
+#include "gezondheid.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+
+// --------------------------------------------------------------------
+
+namespace
+{
+
+// Connections idle for longer than this are checked before reuse
+constexpr std::chrono::seconds kCheckNa{ 30 };
+
+// Maximum time to wait for a connection to become available
+constexpr std::chrono::seconds kWachtTijd{ 10 };
+
+constexpr std::chrono::milliseconds kMinBackoff{ 500 }, kMaxBackoff{ 30000 };
+
+} // namespace
+
+std::unique_ptr<ConnectionPool> ConnectionPool::s_instance;
+
+void ConnectionPool::init(const std::string &connection_string, size_t size)
+{
+	s_instance.reset(new ConnectionPool(connection_string, size));
+}
+
+ConnectionPool &ConnectionPool::instance()
+{
+	return *s_instance;
+}
+
+ConnectionPool::ConnectionPool(const std::string &connection_string, size_t size)
+	: m_connection_string(connection_string)
+	, m_size(std::max<size_t>(size, 1))
+{
+	// Connections are opened when first borrowed, not here
+	Gezondheid::instance().meld("databank", Toestand::opstarten);
+}
+
+Histogram &ConnectionPool::prepare(const std::string &name, const std::string &sql)
+{
+	std::unique_lock lock(m_mutex);
+	m_statements.emplace_back(name, sql);
+
+	return db_query_histogram(name);
+}
+
+ConnectionPool::Lease ConnectionPool::borrow()
+{
+	Verbinding verbinding;
+	std::vector<std::tuple<std::string, std::string>> statements;
+
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (not m_cv.wait_for(lock, kWachtTijd, [this]
+				{ return not m_idle.empty() or m_open < m_size; }))
+			throw std::runtime_error("Geen databank verbinding beschikbaar");
+
+		if (not m_idle.empty())
+		{
+			verbinding = std::move(m_idle.back());
+			m_idle.pop_back();
+		}
+		else
+			++m_open;
+	}
+
+	try
+	{
+		if (verbinding.connection and not check(verbinding))
+			verbinding = {};
+
+		if (not verbinding.connection)
+			verbinding.connection = connect();
+
+		// statements are only ever appended, so prepare the ones this
+		// connection has not seen yet
+		{
+			std::unique_lock lock(m_mutex);
+			statements.assign(m_statements.begin() + verbinding.prepared, m_statements.end());
+		}
+
+		for (auto &[name, sql] : statements)
+			verbinding.connection->prepare(name, sql);
+
+		verbinding.prepared += statements.size();
+	}
+	catch (...)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			--m_open;
+		}
+
+		m_cv.notify_one();
+		throw;
+	}
+
+	return Lease(this, std::move(verbinding));
+}
+
+std::unique_ptr<pqxx::connection> ConnectionPool::connect()
+{
+	{
+		std::unique_lock lock(m_mutex);
+		if (std::chrono::steady_clock::now() < m_niet_voor)
+			throw pqxx::broken_connection("Databank niet bereikbaar");
+	}
+
+	try
+	{
+		auto result = std::make_unique<pqxx::connection>(m_connection_string);
+
+		{
+			std::unique_lock lock(m_mutex);
+			m_backoff = {};
+		}
+
+		Gezondheid::instance().meld("databank", Toestand::gereed);
+
+		return result;
+	}
+	catch (const pqxx::broken_connection &ex)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+
+			m_backoff = std::min(m_backoff.count() == 0 ? kMinBackoff : m_backoff * 2, kMaxBackoff);
+			m_niet_voor = std::chrono::steady_clock::now() + m_backoff;
+		}
+
+		Gezondheid::instance().meld("databank", Toestand::fout, ex.what());
+
+		throw;
+	}
+}
+
+bool ConnectionPool::check(Verbinding &verbinding)
+{
+	if (not verbinding.connection->is_open())
+		return false;
+
+	if (std::chrono::steady_clock::now() - verbinding.gebruikt < kCheckNa)
+		return true;
+
+	try
+	{
+		pqxx::nontransaction tx(*verbinding.connection);
+		tx.exec("SELECT 1");
+		return true;
+	}
+	catch (const std::exception &)
+	{
+		return false;
+	}
+}
+
+void ConnectionPool::release(Verbinding &&verbinding)
+{
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (verbinding.connection and verbinding.connection->is_open())
+		{
+			verbinding.gebruikt = std::chrono::steady_clock::now();
+			m_idle.emplace_back(std::move(verbinding));
+		}
+		else
+			--m_open;
+	}
+
+	m_cv.notify_one();
+}
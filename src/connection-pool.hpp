@@ -0,0 +1,141 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <pqxx/pqxx>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+class Histogram;
+
+// --------------------------------------------------------------------
+// A bounded pool of PostgreSQL connections shared by all threads.
+// Connections are opened on demand up to the maximum size, a borrower
+// waits when all of them are in use. Prepared statements are registered
+// once and prepared on each connection before it is handed out.
+
+class ConnectionPool
+{
+	struct Verbinding
+	{
+		std::unique_ptr<pqxx::connection> connection;
+		size_t prepared = 0;
+		std::chrono::steady_clock::time_point gebruikt;
+	};
+
+  public:
+	static void init(const std::string &connection_string, size_t size);
+	static ConnectionPool &instance();
+
+	// A borrowed connection, it is returned to the pool when the lease
+	// goes out of scope. Broken connections are closed instead.
+	class Lease
+	{
+	  public:
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+
+		Lease(Lease &&rhs) noexcept
+			: m_pool(std::exchange(rhs.m_pool, nullptr))
+			, m_verbinding(std::move(rhs.m_verbinding))
+		{
+		}
+
+		~Lease()
+		{
+			if (m_pool)
+				m_pool->release(std::move(m_verbinding));
+		}
+
+		pqxx::connection &operator*() const { return *m_verbinding.connection; }
+		pqxx::connection *operator->() const { return m_verbinding.connection.get(); }
+
+		// Mark the connection as broken, it will not be reused
+		void discard()
+		{
+			m_verbinding.connection.reset();
+		}
+
+	  private:
+		friend class ConnectionPool;
+
+		Lease(ConnectionPool *pool, Verbinding &&verbinding)
+			: m_pool(pool)
+			, m_verbinding(std::move(verbinding))
+		{
+		}
+
+		ConnectionPool *m_pool;
+		Verbinding m_verbinding;
+	};
+
+	Lease borrow();
+
+	// Register a prepared statement for all connections in this pool.
+	// Returns the latency histogram of the statement, keep the reference.
+	Histogram &prepare(const std::string &name, const std::string &sql);
+
+	size_t get_size() const
+	{
+		return m_size;
+	}
+
+	// For connections that are not shared, e.g. to LISTEN
+	const std::string &get_connection_string() const
+	{
+		return m_connection_string;
+	}
+
+  private:
+	ConnectionPool(const std::string &connection_string, size_t size);
+
+	std::unique_ptr<pqxx::connection> connect();
+	bool check(Verbinding &verbinding);
+	void release(Verbinding &&verbinding);
+
+	std::string m_connection_string;
+	size_t m_size;
+	size_t m_open = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::vector<Verbinding> m_idle;
+	std::vector<std::tuple<std::string, std::string>> m_statements;
+
+	// Reconnect backoff, connect attempts fail fast until m_niet_voor
+	std::chrono::steady_clock::time_point m_niet_voor;
+	std::chrono::milliseconds m_backoff{ 0 };
+
+	static std::unique_ptr<ConnectionPool> s_instance;
+};
@@ -25,21 +25,30 @@
  */
 
 #include "data-service.hpp"
+#include "gezondheid.hpp"
+#include "grafiek-cache.hpp"
+#include "grafiek-opslag.hpp"
+#include "grafiek-schrijver.hpp"
+#include "grafiek-store.hpp"
+#include "metrics.hpp"
 #include "p1-service.hpp"
 #include "sessy-service.hpp"
+#include "trace.hpp"
 
 #include <date/tz.h>
 
 #include <mcfp/mcfp.hpp>
 
+#include <zeep/json/element.hpp>
 #include <zeep/value-serializer.hpp>
 
 #include <iostream>
+#include <sstream>
+#include <streambuf>
 
 // --------------------------------------------------------------------
 
 std::unique_ptr<DataService_v2> DataService_v2::s_instance;
-thread_local std::unique_ptr<pqxx::connection> DataService_v2::s_connection;
 
 // --------------------------------------------------------------------
 
@@ -65,102 +74,184 @@ DataService_v2 &DataService_v2::instance()
 	return *s_instance;
 }
 
+void DataService_v2::stop()
+{
+	s_instance.reset();
+}
+
 DataService_v2::DataService_v2()
 {
 	auto &config = mcfp::config::instance();
 
-	m_connection_string = config.get("databank");
 	m_read_only = config.has("read-only");
 
-	// try it
-	pqxx::transaction tx(get_connection());
+	m_interval = std::chrono::seconds{ std::max(config.get<int>("sample-interval"), 1) };
+
+	// The recent data is loaded by the collecting thread
+	if (auto dagen = config.get<size_t>("grafiek-dagen"); dagen > 0)
+	{
+		m_recent = std::make_unique<GrafiekStore>(dagen);
+		Gezondheid::instance().meld("grafiek", Toestand::opstarten);
+	}
+
+	m_opslag = GrafiekOpslag::create();
+
+	if (not m_read_only)
+	{
+		// By default write about once every two minutes, whatever the sample rate
+		size_t batch_size;
+		if (config.has("store-batch"))
+			batch_size = config.get<size_t>("store-batch");
+		else
+			batch_size = std::chrono::seconds{ 120 } / m_interval;
+
+		auto beleid = config.get("schrijf-beleid");
+		if (beleid != "wacht" and beleid != "verwerp")
+			throw std::runtime_error("Onbekend schrijf-beleid: " + beleid);
+
+		m_schrijver = std::make_unique<GrafiekSchrijver>(
+			[this](const std::vector<GrafiekPunt> &batch)
+			{ write(batch); },
+			batch_size, config.get<size_t>("schrijf-wachtrij"),
+			beleid == "wacht" ? SchrijfBeleid::wacht : SchrijfBeleid::verwerp);
+	}
 
 	// start collecting thread
-	m_thread = std::thread(std::bind(&DataService_v2::run, this));
+	m_thread = std::jthread([this](std::stop_token stop)
+		{ run(stop); });
 }
 
-pqxx::connection &DataService_v2::get_connection()
+DataService_v2::~DataService_v2()
 {
-	if (not s_connection)
-		s_connection.reset(new pqxx::connection(m_connection_string));
-	return *s_connection;
+	// The collector stores the sample of the interval in progress before
+	// it stops, after that the writer drains its queue
+	m_thread.request_stop();
+	if (m_thread.joinable())
+		m_thread.join();
+
+	m_schrijver.reset();
 }
 
-void DataService_v2::reset_connection()
+void DataService_v2::store(const GrafiekPunt &pt)
 {
-	s_connection.reset(nullptr);
+	static auto &s_store_tijd = Metrieken::instance().histogram("energyd_store_seconds", "Time to store a status graph sample");
+	static auto &s_store_fouten = Metrieken::instance().teller("energyd_store_failures_total", "Status graph samples that could not be queued for writing");
+
+	MeetTijd meting(s_store_tijd);
+	TraceSpan span("collector", "store");
+
+	if (m_recent)
+		m_recent->append(pt);
+
+	if (m_schrijver and not m_schrijver->push(pt))
+		s_store_fouten.inc();
 }
 
-void DataService_v2::store(const GrafiekPunt &pt)
+SchrijverStatus DataService_v2::get_schrijver_status() const
+{
+	return m_schrijver ? m_schrijver->get_status() : SchrijverStatus{};
+}
+
+void DataService_v2::write(const std::vector<GrafiekPunt> &batch)
 {
-	if (m_read_only)
-		return;
+	using namespace date;
+
+	static auto &s_write_tijd = Metrieken::instance().histogram("energyd_store_write_seconds", "Time to write a batch of status graph samples");
+	static auto &s_write_fouten = Metrieken::instance().teller("energyd_store_write_failures_total", "Batches of status graph samples that could not be written");
 
-	bool first_reset = true;
-	do
+	try
 	{
-		try
-		{
-			pqxx::transaction tx(get_connection());
-
-			tx.exec("INSERT INTO daily_graph (soc, batterij, verbruik, levering, opwekking) VALUES (" +
-					tx.quote(pt.laad_niveau) + ", " +
-					tx.quote(pt.batterij) + ", " +
-					tx.quote(pt.verbruik) + ", " +
-					tx.quote(pt.levering) + ", " +
-					tx.quote(pt.zon) + ")");
-			tx.commit();
-		}
-		catch (const pqxx::broken_connection &e)
-		{
-			if (first_reset)
-			{
-				first_reset = false;
-				reset_connection();
-				continue;
-			}
-			std::cerr << "Failed to write opname: " << e.what() << '\n';
-		}
-	} while (false);
+		MeetTijd meting(s_write_tijd);
+		TraceSpan span("opslag", "schrijf", "aantal", static_cast<int64_t>(batch.size()));
+		m_opslag->schrijf(batch);
+	}
+	catch (const std::exception &ex)
+	{
+		s_write_fouten.inc();
+		Gezondheid::instance().meld("opslag", Toestand::fout, ex.what());
+		throw;
+	}
+
+	Gezondheid::instance().meld("opslag", Toestand::gereed);
+
+	for (auto &pt : batch)
+		GrafiekCache::instance().invalidate(year_month_day{ floor<days>(make_zoned(current_zone(), pt.tijd).get_local_time()) });
 }
 
 // --------------------------------------------------------------------
 
-void DataService_v2::run()
+void DataService_v2::run(std::stop_token stop)
 {
 	using namespace std::literals;
 	using namespace date;
 	using namespace std::chrono;
 
-	using two_minutes = std::chrono::duration<int64_t, std::ratio<60 * 2>>;
+	// The next multiple of the interval, counted from the epoch
+	auto next_tick = [interval = m_interval](system_clock::time_point t)
+	{
+		auto s = ceil<seconds>(t).time_since_epoch();
+		return system_clock::time_point{ ((s + interval - 1s) / interval) * interval };
+	};
 
 	auto now = std::chrono::system_clock::now();
-	auto next = ceil<two_minutes>(now);
+	auto next = next_tick(now);
+	auto vorige = now;
+
+	bool warm = m_recent == nullptr;
+
+	if (Trace::actief())
+		Trace::instance().thread_naam("collector");
 
 	for (;;)
 	{
-		std::this_thread::sleep_until(next);
+		if (not warm and not stop.stop_requested())
+			warm = warm_recent();
 
-		// auto opname = P1Service::instance().get_current();
-		auto status = P1Service::instance().get_status();
-		auto sessy = SessyService::instance().get_soc();
+		bool gestopt = not slaap_tot(stop, next);
 
 		now = std::chrono::system_clock::now();
-		next = ceil<two_minutes>(now);
-
-		GrafiekPunt pt{
-			.tijd = now,
-			.zon = std::accumulate(sessy.begin(), sessy.end(), 0.f, [](float sum, SessySOC &s)
-				{ return sum + s.phase[0].power + sum + s.phase[1].power + sum + s.phase[2].power; }),
-			.batterij = std::accumulate(sessy.begin(), sessy.end(), 0.f, [](float sum, SessySOC &s)
-									  { return sum + s.sessy.power; }),
-			.verbruik = 1000 * status.power_consumed,
-			.levering = 1000 * status.power_produced,
-			.laad_niveau = sessy.size() ? std::accumulate(sessy.begin(), sessy.end(), 0.f, [](float sum, SessySOC &s)
-											  { return sum + s.sessy.state_of_charge; }) /
-			                                  sessy.size()
-			                            : 0,
-		};
+
+		// When stopped, the interval in progress is stored as a last,
+		// shorter sample. Unless it has only just begun.
+		if (gestopt and now - vorige < 1s)
+			break;
+
+		// the lateness of the tick is recorded as argument
+		TraceSpan tick_span("collector", gestopt ? "laatste" : "tick", "te_laat_ms", duration_cast<milliseconds>(now - next).count());
+
+		next = next_tick(now);
+		vorige = now;
+
+		GrafiekPunt pt;
+
+		{
+			TraceSpan aggregatie_span("collector", "aggregatie");
+
+			auto [verbruik, levering] = P1Service::instance().take_interval(now);
+			auto [zon, batterij, laad_niveau] = SessyService::instance().take_interval(now);
+
+			pt = GrafiekPunt{
+				.tijd = now,
+				.zon = zon.gem,
+				.batterij = batterij.gem,
+				.verbruik = verbruik.gem,
+				.levering = levering.gem,
+				.laad_niveau = laad_niveau.gem,
+
+				.zon_min = zon.min,
+				.zon_max = zon.max,
+				.zon_wh = zon.wh,
+				.batterij_min = batterij.min,
+				.batterij_max = batterij.max,
+				.batterij_wh = batterij.wh,
+				.verbruik_min = verbruik.min,
+				.verbruik_max = verbruik.max,
+				.verbruik_wh = verbruik.wh,
+				.levering_min = levering.min,
+				.levering_max = levering.max,
+				.levering_wh = levering.wh
+			};
+		}
 
 		try
 		{
@@ -172,87 +263,267 @@ void DataService_v2::run()
 					  << "trying to store\n"
 					  << pt << "\n";
 		}
+
+		if (gestopt)
+			break;
 	}
 }
 
-std::vector<GrafiekPunt> DataService_v2::grafiekVoorDag(date::year_month_day dag, std::chrono::minutes resolutie)
+// --------------------------------------------------------------------
+// Combine samples into one point, means are averaged, extremes are
+// kept and energy is summed
+
+class GrafiekSom
 {
-	std::vector<GrafiekPunt> data, result;
-	pqxx::transaction tx(get_connection());
+  public:
+	void add(const GrafiekPunt &p)
+	{
+		if (m_n++ == 0)
+		{
+			m_som = p;
+			return;
+		}
 
-	// Initialise data
-	using namespace date;
-	using namespace std::chrono_literals;
+		for (auto &v : kGrafiekVelden)
+		{
+			switch (v.aggregatie)
+			{
+				case GrafiekAggregatie::gemiddelde:
+				case GrafiekAggregatie::som:
+					m_som.*v.veld += p.*v.veld;
+					break;
+				case GrafiekAggregatie::minimum:
+					m_som.*v.veld = std::min(m_som.*v.veld, p.*v.veld);
+					break;
+				case GrafiekAggregatie::maximum:
+					m_som.*v.veld = std::max(m_som.*v.veld, p.*v.veld);
+					break;
+			}
+		}
+	}
+
+	bool empty() const
+	{
+		return m_n == 0;
+	}
+
+	GrafiekPunt get(std::chrono::system_clock::time_point t) const
+	{
+		GrafiekPunt result = m_som;
+
+		result.tijd = t;
+		for (auto &v : kGrafiekVelden)
+		{
+			if (v.aggregatie == GrafiekAggregatie::gemiddelde)
+				result.*v.veld /= m_n;
+		}
+
+		return result;
+	}
+
+	void reset()
+	{
+		m_n = 0;
+	}
 
-	auto day = local_time<days>{ dag.year() / dag.month() / dag.day() };
-	auto day_after = day + days{ 1 };
+  private:
+	GrafiekPunt m_som{};
+	size_t m_n = 0;
+};
 
-	std::stringstream d1;
-	d1 << day;
+// --------------------------------------------------------------------
+// Streams the status graph for a period as JSON. The points are read
+// from the storage and aggregated on the fly.
 
-	std::stringstream d2;
-	d2 << day_after;
+class GrafiekStreamBuf : public std::streambuf
+{
+  public:
+	GrafiekStreamBuf(std::unique_ptr<GrafiekLezer> lezer, std::chrono::system_clock::time_point start,
+		std::chrono::minutes resolutie, bool raw)
+		: m_lezer(std::move(lezer))
+		, m_start(start)
+		, m_resolutie(resolutie)
+		, m_raw(raw)
+	{
+	}
 
-	for (const auto &[tijd, soc, batterij, verbruik, levering, opwekking] :
-		tx.stream<std::string, float, float, float, float, float>(
-			// clang-format off
-			R"(SELECT trim(both '\"' from to_json(tijd)::text) AS tijd, soc, batterij, verbruik, levering, opwekking
-			   FROM daily_graph
-			   WHERE tijd BETWEEN )" + tx.quote(d1.str()) + " AND " + tx.quote(d2.str()) +
-		    "  ORDER BY tijd ASC"
-			// clang-format on
-			))
+  protected:
+	int_type underflow() override
 	{
-		local_time<std::chrono::seconds> t;
-		std::istringstream is(tijd);
-		is >> parse("%FT%T", t);
+		m_buffer.clear();
 
-		if (is.fail())
-			continue;
-		
-		auto t2 = make_zoned(current_zone(), t);
+		while (m_buffer.size() < kBufferSize and not m_done)
+			volgende();
 
-		data.emplace_back(t2.get_sys_time(), opwekking, batterij, verbruik, levering, soc);
+		if (m_buffer.empty())
+			return traits_type::eof();
+
+		setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + m_buffer.size());
+		return traits_type::to_int_type(m_buffer.front());
 	}
 
-	if (resolutie <= 2min)
-		std::swap(data, result);
-	else
+  private:
+	static constexpr size_t kBufferSize = 16384;
+
+	void volgende()
 	{
-		auto t1 = date::zoned_time(date::current_zone(), day);
-		auto t2 = t1.get_sys_time() + 24h;
+		GrafiekPunt pt;
 
-		for (auto t = t1.get_sys_time(); t < t2; t += resolutie)
+		if (not m_lezer->volgende(pt))
 		{
-			GrafiekPunt pt{ .tijd = t };
+			if (not m_som.empty())
+				schrijf(m_som.get(m_blok));
 
-			size_t N = 0;
-			for (auto &p : data)
-			{
-				if (p.tijd < t)
-					continue;
-				if (p.tijd >= t + resolutie)
-					break;
+			m_buffer += m_eerste ? "[]" : "]";
+			m_done = true;
+			return;
+		}
 
-				pt.zon += p.zon;
-				pt.batterij += p.batterij;
-				pt.verbruik += p.verbruik;
-				pt.levering += p.levering;
-				pt.laad_niveau += p.laad_niveau;
+		if (m_raw)
+			schrijf(pt);
+		else
+		{
+			auto blok = m_start + ((pt.tijd - m_start) / m_resolutie) * m_resolutie;
 
-				++N;
+			if (not m_som.empty() and blok != m_blok)
+			{
+				schrijf(m_som.get(m_blok));
+				m_som.reset();
 			}
 
-			if (N == 0)
-				continue;
+			m_blok = blok;
+			m_som.add(pt);
+		}
+	}
+
+	void schrijf(const GrafiekPunt &pt)
+	{
+		zeep::json::element e;
+		to_element(e, pt);
+
+		std::ostringstream os;
+		os << (m_eerste ? '[' : ',') << e;
+		m_buffer += os.str();
+
+		m_eerste = false;
+	}
+
+	std::unique_ptr<GrafiekLezer> m_lezer;
+
+	std::chrono::system_clock::time_point m_start, m_blok;
+	std::chrono::minutes m_resolutie;
+	bool m_raw;
+	GrafiekSom m_som;
+
+	std::string m_buffer;
+	bool m_eerste = true, m_done = false;
+};
+
+class GrafiekStream : public std::istream
+{
+  public:
+	template <typename... Args>
+	GrafiekStream(Args &&...args)
+		: std::istream(nullptr)
+		, m_buf(std::forward<Args>(args)...)
+	{
+		rdbuf(&m_buf);
+	}
+
+  private:
+	GrafiekStreamBuf m_buf;
+};
+
+std::unique_ptr<std::istream> DataService_v2::grafiekVoorPeriode(date::year_month_day van, date::year_month_day tot, std::chrono::minutes resolutie)
+{
+	if (not van.ok() or not tot.ok() or tot < van)
+		throw std::runtime_error("Ongeldige periode");
+
+	auto begin = date::make_zoned(date::current_zone(), date::local_days{ van }).get_sys_time();
+	auto end = date::make_zoned(date::current_zone(), date::local_days{ tot } + date::days{ 1 }).get_sys_time();
+
+	return std::make_unique<GrafiekStream>(m_opslag->open(begin, end), begin, resolutie, resolutie <= m_interval);
+}
+
+// --------------------------------------------------------------------
+
+bool DataService_v2::warm_recent()
+{
+	using namespace date;
+
+	bool result = false;
+
+	try
+	{
+		auto vandaag = floor<days>(make_zoned(current_zone(), std::chrono::system_clock::now()).get_local_time());
+		auto vanaf = vandaag - days{ static_cast<int>(m_recent->get_dagen()) - 1 };
+
+		std::vector<GrafiekPunt> data;
+
+		m_opslag->lees(make_zoned(current_zone(), vanaf).get_sys_time(), std::chrono::system_clock::time_point::max(),
+			[&data](const GrafiekPunt &pt)
+			{ data.emplace_back(pt); });
+
+		m_recent->warm(vanaf, data);
+		result = true;
+
+		Gezondheid::instance().meld("grafiek", Toestand::gereed);
+	}
+	catch (const std::exception &ex)
+	{
+		std::clog << "Failed to load recent status graph data: " << ex.what() << '\n';
+		Gezondheid::instance().meld("grafiek", Toestand::fout, ex.what());
+	}
+
+	return result;
+}
+
+std::vector<GrafiekPunt> DataService_v2::grafiekVoorDag(date::year_month_day dag, std::chrono::minutes resolutie,
+	std::optional<std::chrono::system_clock::time_point> sinds)
+{
+	if (m_recent)
+	{
+		if (auto result = m_recent->grafiekVoorDag(dag, resolutie, resolutie <= m_interval, sinds))
+			return std::move(*result);
+	}
+
+	std::vector<GrafiekPunt> data, result;
+
+	using namespace date;
+	using namespace std::chrono_literals;
+
+	std::chrono::system_clock::time_point t1 = make_zoned(current_zone(), local_days{ dag }).get_sys_time();
+	auto t2 = t1 + 24h;
+
+	if (sinds and *sinds > t1)
+	{
+		if (resolutie <= m_interval)
+			t1 = *sinds;
+		else
+			t1 += ((*sinds - t1) / resolutie) * resolutie;
+	}
+
+	m_opslag->lees(t1, t2, [&data](const GrafiekPunt &pt)
+		{ data.emplace_back(pt); });
+
+	if (resolutie <= m_interval)
+		std::swap(data, result);
+	else
+	{
+		// data is sorted on time, so a single pass suffices
+		auto p = data.begin();
+
+		for (auto t = t1; t < t2; t += resolutie)
+		{
+			while (p != data.end() and p->tijd < t)
+				++p;
 
-			pt.zon /= N;
-			pt.batterij /= N;
-			pt.verbruik /= N;
-			pt.levering /= N;
-			pt.laad_niveau /= N;
+			GrafiekSom som;
+			for (; p != data.end() and p->tijd < t + resolutie; ++p)
+				som.add(*p);
 
-			result.emplace_back(std::move(pt));
+			if (not som.empty())
+				result.emplace_back(som.get(t));
 		}
 	}
 
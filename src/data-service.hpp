@@ -29,12 +29,18 @@
 #include <zeep/nvp.hpp>
 
 #include <date/date.h>
-#include <pqxx/pqxx>
 
 #include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <istream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
 #include <string>
 #include <thread>
+#include <vector>
 
 struct P1Opname
 {
@@ -128,6 +134,9 @@ struct SessySOC
 
 // --------------------------------------------------------------------
 
+// The power values are the mean over the interval in W, the _min and
+// _max values the extremes seen and _wh the energy in Wh.
+
 struct GrafiekPunt
 {
 	std::chrono::system_clock::time_point tijd;
@@ -137,6 +146,11 @@ struct GrafiekPunt
 	float levering;
 	float laad_niveau;
 
+	float zon_min, zon_max, zon_wh;
+	float batterij_min, batterij_max, batterij_wh;
+	float verbruik_min, verbruik_max, verbruik_wh;
+	float levering_min, levering_max, levering_wh;
+
 	template <typename Archive>
 	void serialize(Archive &ar, unsigned long version)
 	{
@@ -145,37 +159,137 @@ struct GrafiekPunt
 		   & zeep::make_nvp("batterij", batterij)
 		   & zeep::make_nvp("verbruik", verbruik)
 		   & zeep::make_nvp("levering", levering)
-		   & zeep::make_nvp("laad_niveau", laad_niveau);
+		   & zeep::make_nvp("laad_niveau", laad_niveau)
+		   & zeep::make_nvp("zon_min", zon_min)
+		   & zeep::make_nvp("zon_max", zon_max)
+		   & zeep::make_nvp("zon_wh", zon_wh)
+		   & zeep::make_nvp("batterij_min", batterij_min)
+		   & zeep::make_nvp("batterij_max", batterij_max)
+		   & zeep::make_nvp("batterij_wh", batterij_wh)
+		   & zeep::make_nvp("verbruik_min", verbruik_min)
+		   & zeep::make_nvp("verbruik_max", verbruik_max)
+		   & zeep::make_nvp("verbruik_wh", verbruik_wh)
+		   & zeep::make_nvp("levering_min", levering_min)
+		   & zeep::make_nvp("levering_max", levering_max)
+		   & zeep::make_nvp("levering_wh", levering_wh);
 	}
 };
 
+// The float members of GrafiekPunt with the way they combine when
+// samples are aggregated, for code that handles them as columns.
+
+enum class GrafiekAggregatie
+{
+	gemiddelde,
+	minimum,
+	maximum,
+	som
+};
+
+struct GrafiekVeld
+{
+	const char *naam;
+	float GrafiekPunt::*veld;
+	GrafiekAggregatie aggregatie;
+};
+
+inline constexpr GrafiekVeld kGrafiekVelden[] = {
+	{ "zon", &GrafiekPunt::zon, GrafiekAggregatie::gemiddelde },
+	{ "batterij", &GrafiekPunt::batterij, GrafiekAggregatie::gemiddelde },
+	{ "verbruik", &GrafiekPunt::verbruik, GrafiekAggregatie::gemiddelde },
+	{ "levering", &GrafiekPunt::levering, GrafiekAggregatie::gemiddelde },
+	{ "laad_niveau", &GrafiekPunt::laad_niveau, GrafiekAggregatie::gemiddelde },
+	{ "zon_min", &GrafiekPunt::zon_min, GrafiekAggregatie::minimum },
+	{ "zon_max", &GrafiekPunt::zon_max, GrafiekAggregatie::maximum },
+	{ "zon_wh", &GrafiekPunt::zon_wh, GrafiekAggregatie::som },
+	{ "batterij_min", &GrafiekPunt::batterij_min, GrafiekAggregatie::minimum },
+	{ "batterij_max", &GrafiekPunt::batterij_max, GrafiekAggregatie::maximum },
+	{ "batterij_wh", &GrafiekPunt::batterij_wh, GrafiekAggregatie::som },
+	{ "verbruik_min", &GrafiekPunt::verbruik_min, GrafiekAggregatie::minimum },
+	{ "verbruik_max", &GrafiekPunt::verbruik_max, GrafiekAggregatie::maximum },
+	{ "verbruik_wh", &GrafiekPunt::verbruik_wh, GrafiekAggregatie::som },
+	{ "levering_min", &GrafiekPunt::levering_min, GrafiekAggregatie::minimum },
+	{ "levering_max", &GrafiekPunt::levering_max, GrafiekAggregatie::maximum },
+	{ "levering_wh", &GrafiekPunt::levering_wh, GrafiekAggregatie::som }
+};
+
+inline constexpr size_t kAantalGrafiekVelden = std::size(kGrafiekVelden);
+
 // --------------------------------------------------------------------
+// Sleeps until t, or until a stop is requested. Returns false in
+// the latter case.
+
+template <typename Clock, typename Duration>
+bool slaap_tot(std::stop_token stop, std::chrono::time_point<Clock, Duration> t)
+{
+	std::mutex mutex;
+	std::condition_variable_any cv;
+
+	std::unique_lock lock(mutex);
+	cv.wait_until(lock, stop, t, []
+		{ return false; });
+
+	return not stop.stop_requested();
+}
+
+// --------------------------------------------------------------------
+
+class GrafiekOpslag;
+class GrafiekSchrijver;
+class GrafiekStore;
+struct SchrijverStatus;
 
 class DataService_v2
 {
   public:
 	static DataService_v2 &instance();
 
+	// Stops collecting, the samples of the current interval and those
+	// still waiting to be written are stored first
+	static void stop();
+
+	~DataService_v2();
+
+	// Never blocks on the storage, samples are written by a separate thread
 	void store(const GrafiekPunt &pt);
 
-	void reset_connection();
+	SchrijverStatus get_schrijver_status() const;
+
+	// With sinds only the points at or after sinds are returned, when the
+	// points are aggregated this includes the interval containing sinds.
+	std::vector<GrafiekPunt> grafiekVoorDag(date::year_month_day dag, std::chrono::minutes resolutie,
+		std::optional<std::chrono::system_clock::time_point> sinds = {});
 
-	std::vector<GrafiekPunt> grafiekVoorDag(date::year_month_day dag, std::chrono::minutes resolutie);
+	// Returns a stream producing the JSON array of points for the days
+	// van up to and including tot. Rows are read and written one block
+	// at a time, so memory use does not depend on the length of the period.
+	std::unique_ptr<std::istream> grafiekVoorPeriode(date::year_month_day van, date::year_month_day tot, std::chrono::minutes resolutie);
+
+	std::chrono::seconds get_interval() const
+	{
+		return m_interval;
+	}
 
   private:
 
 	DataService_v2();
 
-	pqxx::connection &get_connection();
+	void run(std::stop_token stop);
+
+	void write(const std::vector<GrafiekPunt> &batch);
 
-	void run();
+	bool warm_recent();
 
-	std::string m_connection_string;
+	std::unique_ptr<GrafiekOpslag> m_opslag;
 
-	std::thread m_thread;
-	std::mutex m_mutex;
+	std::unique_ptr<GrafiekSchrijver> m_schrijver;
+
+	std::jthread m_thread;
 	bool m_read_only;
 
+	std::chrono::seconds m_interval;
+
+	std::unique_ptr<GrafiekStore> m_recent;
+
 	static std::unique_ptr<DataService_v2> s_instance;
-	static thread_local std::unique_ptr<pqxx::connection> s_connection;
 };
\ No newline at end of file
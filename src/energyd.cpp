@@ -8,12 +8,24 @@
 #include "mrsrc.hpp"
 #include "revision.hpp"
 
+#include "compressie.hpp"
+#include "connection-pool.hpp"
 #include "data-service.hpp"
+#include "gezondheid.hpp"
+#include "grafiek-cache.hpp"
+#include "grafiek-schrijver.hpp"
+#include "kolommen.hpp"
+#include "metrics.hpp"
 #include "p1-service.hpp"
 #include "sessy-service.hpp"
+#include "single-flight.hpp"
+#include "stand-map.hpp"
+#include "trace.hpp"
+#include "uitvoerder.hpp"
 
 #include <utility>
 
+#include <zeep/http/controller.hpp>
 #include <zeep/http/daemon.hpp>
 #include <zeep/http/html-controller.hpp>
 #include <zeep/http/server.hpp>
@@ -28,8 +40,18 @@
 
 #include <pqxx/pqxx>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <thread>
 #include <tuple>
 
 namespace fs = std::filesystem;
@@ -88,11 +110,111 @@ std::chrono::system_clock::time_point makeTimePoint(const std::string &s)
 	return result;
 }
 
+// Accepts both the JSON format of a time and the database format
+std::chrono::system_clock::time_point makeTimePointFromJSON(std::string s)
+{
+	if (not s.empty() and s.back() == 'Z')
+		s.pop_back();
+	std::replace(s.begin(), s.end(), 'T', ' ');
+	return makeTimePoint(s);
+}
+
+// The readings of one opname, keyed by teller id. There are only a
+// handful of meters so the readings are stored inline, sorted on id.
+// Only when there are more than kInline a heap buffer is used.
+
+struct Stand
+{
+	int teller_id;
+	float stand;
+};
+
+class Standen
+{
+  public:
+	using const_iterator = const Stand *;
+
+	const_iterator begin() const { return data(); }
+	const_iterator end() const { return data() + m_size; }
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	void set(int teller_id, float stand)
+	{
+		auto b = data(), e = b + m_size;
+		auto i = std::lower_bound(b, e, teller_id, [](const Stand &s, int id)
+			{ return s.teller_id < id; });
+
+		if (i != e and i->teller_id == teller_id)
+		{
+			i->stand = stand;
+			return;
+		}
+
+		auto ix = i - b;
+
+		if (m_size == kInline and m_heap.empty())
+			m_heap.assign(m_inline.begin(), m_inline.end());
+
+		if (m_heap.empty())
+		{
+			std::move_backward(m_inline.begin() + ix, m_inline.begin() + m_size, m_inline.begin() + m_size + 1);
+			m_inline[ix] = { teller_id, stand };
+		}
+		else
+			m_heap.insert(m_heap.begin() + ix, { teller_id, stand });
+
+		++m_size;
+	}
+
+	std::optional<float> get(int teller_id) const
+	{
+		auto i = std::lower_bound(begin(), end(), teller_id, [](const Stand &s, int id)
+			{ return s.teller_id < id; });
+
+		if (i != end() and i->teller_id == teller_id)
+			return i->stand;
+
+		return {};
+	}
+
+  private:
+	static constexpr size_t kInline = 8;
+
+	const Stand *data() const { return m_heap.empty() ? m_inline.data() : m_heap.data(); }
+	Stand *data() { return m_heap.empty() ? m_inline.data() : m_heap.data(); }
+
+	std::array<Stand, kInline> m_inline;
+	std::vector<Stand> m_heap;
+	size_t m_size = 0;
+};
+
+// In JSON the readings are an object with the teller id as key
+void to_element(zeep::json::element &e, const Standen &standen)
+{
+	if (standen.empty())
+		zeep::json::to_element(e, std::map<std::string, float>{});
+
+	for (auto &[teller_id, stand] : standen)
+		e[std::to_string(teller_id)] = stand;
+}
+
+void from_element(const zeep::json::element &e, Standen &standen)
+{
+	std::map<std::string, float> m;
+	zeep::json::from_element(e, m);
+
+	standen = {};
+	for (auto &[teller_id, stand] : m)
+		standen.set(std::stoi(teller_id), stand);
+}
+
 struct Opname
 {
 	std::string id;
 	std::chrono::system_clock::time_point datum;
-	std::map<std::string, float> standen;
+	Standen standen;
 
 	template <typename Archive>
 	void serialize(Archive &ar, unsigned long version)
@@ -101,6 +223,13 @@ struct Opname
 	}
 };
 
+// Number of opnames on one page of the listing
+constexpr int kOpnamesPerPagina = 100, kMaxOpnamesPerPagina = 1000;
+
+// The maximum time an ajax request waits for the reply of an identical
+// request in progress
+constexpr std::chrono::milliseconds kMaxWachtGedeeld{ 10000 };
+
 struct Teller
 {
 	std::string id;
@@ -115,6 +244,16 @@ struct Teller
 	}
 };
 
+// The meters, cached together with their JSON form and the sign
+// used when adding up the readings of several meters
+
+struct TellerGegevens
+{
+	std::vector<Teller> tellers;
+	zeep::json::element json;
+	std::map<int, int> teken;
+};
+
 enum class aggregatie_type
 {
 	dag,
@@ -205,54 +344,28 @@ void from_element(const zeep::json::element &e, grafiek_type &type)
 		throw std::runtime_error("Ongeldige grafiek type");
 }
 
-std::string selector(grafiek_type g)
+// The meters that make up each series. A series is the sum of the
+// readings of its meters taken at the same time.
+
+struct ReeksDefinitie
 {
-	switch (g)
-	{
-		case grafiek_type::warmte:
-			return "SELECT a.tijd, SUM(c.teken * b.stand) "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b LEFT OUTER JOIN teller c ON b.teller_id = c.id ON a.id = b.opname_id "
-				   " WHERE c.id IN (1) GROUP BY a.tijd ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit:
-			return "SELECT a.tijd, SUM(c.teken * b.stand) "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b LEFT OUTER JOIN teller c ON b.teller_id = c.id ON a.id = b.opname_id "
-				   " WHERE c.id IN (2, 3, 4, 5) GROUP BY a.tijd ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_hoog:
-			return "SELECT a.tijd, SUM(c.teken * b.stand) "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b LEFT OUTER JOIN teller c ON b.teller_id = c.id ON a.id = b.opname_id "
-				   " WHERE c.id IN (3, 5) GROUP BY a.tijd ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_laag:
-			return "SELECT a.tijd, SUM(c.teken * b.stand) "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b LEFT OUTER JOIN teller c ON b.teller_id = c.id ON a.id = b.opname_id "
-				   " WHERE c.id IN (2, 4) GROUP BY a.tijd ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_verbruik:
-			return "SELECT a.tijd, SUM(b.stand) "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b ON a.id = b.opname_id "
-				   " WHERE b.teller_id IN (2, 3) GROUP BY a.tijd ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_levering:
-			return "SELECT a.tijd, SUM(b.stand) "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b ON a.id = b.opname_id "
-				   " WHERE b.teller_id IN (4, 5) GROUP BY a.tijd ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_verbruik_hoog:
-			return "SELECT a.tijd, b.stand "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b ON a.id = b.opname_id "
-				   " WHERE b.teller_id = 3 ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_verbruik_laag:
-			return "SELECT a.tijd, b.stand "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b ON a.id = b.opname_id "
-				   " WHERE b.teller_id = 2 ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_levering_hoog:
-			return "SELECT a.tijd, b.stand "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b ON a.id = b.opname_id "
-				   " WHERE b.teller_id = 5 ORDER BY a.tijd ASC";
-		case grafiek_type::electriciteit_levering_laag:
-			return "SELECT a.tijd, b.stand "
-				   " FROM opname a LEFT OUTER JOIN tellerstand b ON a.id = b.opname_id "
-				   " WHERE b.teller_id = 4 ORDER BY a.tijd ASC";
-		default:
-			return "";
-	}
-}
+	grafiek_type type;
+	std::vector<int> tellers;
+	bool met_teken; // multiply the readings with teller.teken
+};
+
+const ReeksDefinitie kReeksen[] = {
+	{ grafiek_type::warmte, { 1 }, true },
+	{ grafiek_type::electriciteit, { 2, 3, 4, 5 }, true },
+	{ grafiek_type::electriciteit_hoog, { 3, 5 }, true },
+	{ grafiek_type::electriciteit_laag, { 2, 4 }, true },
+	{ grafiek_type::electriciteit_verbruik, { 2, 3 }, false },
+	{ grafiek_type::electriciteit_levering, { 4, 5 }, false },
+	{ grafiek_type::electriciteit_verbruik_hoog, { 3 }, false },
+	{ grafiek_type::electriciteit_verbruik_laag, { 2 }, false },
+	{ grafiek_type::electriciteit_levering_hoog, { 5 }, false },
+	{ grafiek_type::electriciteit_levering_laag, { 4 }, false }
+};
 
 struct DataPunt
 {
@@ -269,44 +382,204 @@ struct DataPunt
 	}
 };
 
-// --------------------------------------------------------------------
+std::vector<DataPunt> bereken_grafiek(const StandMap &sm, aggregatie_type aggr, date::sys_days nu);
 
-using StandMap = std::map<std::chrono::system_clock::time_point, float>;
+// The readings as two arrays, to be passed to a single statement
+std::tuple<std::vector<int>, std::vector<float>> as_arrays(const Standen &standen)
+{
+	std::vector<int> tellers;
+	std::vector<float> waarden;
+
+	for (auto &[teller_id, stand] : standen)
+	{
+		tellers.push_back(teller_id);
+		waarden.push_back(stand);
+	}
+
+	return { std::move(tellers), std::move(waarden) };
+}
+
+std::vector<std::string_view> split_csv(std::string_view s, char sep)
+{
+	std::vector<std::string_view> result;
+
+	for (;;)
+	{
+		auto i = s.find(sep);
+		result.push_back(s.substr(0, i));
+
+		if (i == std::string_view::npos)
+			break;
+
+		s.remove_prefix(i + 1);
+	}
+
+	if (sep == '\n' and not result.empty() and result.back().empty())
+		result.pop_back();
+
+	return result;
+}
+
+// Times in an import file are local time, with or without seconds
+std::optional<std::string> parse_import_tijd(std::string_view s)
+{
+	using namespace date;
+
+	for (auto fmt : { "%F %T", "%F %R", "%FT%T", "%FT%R", "%d-%m-%Y %T", "%d-%m-%Y %R" })
+	{
+		local_seconds t;
+		std::istringstream is{ std::string{ s } };
+		is >> parse(fmt, t);
+
+		if (not is.fail())
+			return format("%F %T", t);
+	}
+
+	return {};
+}
+
+// --------------------------------------------------------------------
 
 class DataService
 {
   public:
-	static void init(const std::string &dbConnectString);
+	static void init();
 	static DataService &instance();
 
+	// Stops the listening thread and destroys the instance
+	static void stop();
+
 	std::string post_opname(Opname opname)
 	{
-		pqxx::work tx(get_connection());
-		auto r = tx.exec_prepared1("insert-opname");
+		auto [tellers, standen] = as_arrays(opname.standen);
 
-		int opnameId = r[0].as<int>();
+		int opnameId;
+		std::chrono::system_clock::time_point tijd;
 
-		for (auto stand : opname.standen)
-			tx.exec_prepared("insert-stand", opnameId, stol(stand.first), stand.second);
+		// a single statement inserts the opname and all its readings, the
+		// connection is returned before append_stand which may borrow one
+		{
+			auto connection = ConnectionPool::instance().borrow();
+			pqxx::work tx(*connection);
+			MeetTijd meting(*mInsertOpnameTijd);
+			auto r = tx.exec_prepared1("insert-opname", tellers, standen);
 
-		tx.commit();
+			opnameId = r[0].as<int>();
+			tijd = makeTimePoint(r[1].as<std::string>());
+
+			tx.commit();
+		}
+
+		append_stand(tijd, opname.standen);
 
 		return std::to_string(opnameId);
 	}
 
+	// Import many opnames at once from CSV. The first line contains the
+	// column names: tijd followed by the teller ids. Values are separated
+	// by comma's, or by semicolons in which case a decimal comma is allowed.
+	// Opnames at a time that is already present are skipped. Returns the
+	// number of opnames added.
+	int import_opnames(std::string_view csv)
+	{
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::work tx(*connection);
+
+		static auto &s_import_tijd = db_query_histogram("import-opnames");
+		MeetTijd meting(s_import_tijd);
+		tx.exec0("CREATE TEMPORARY TABLE import_stand (tijd timestamp without time zone, teller_id integer, stand numeric(8,3)) ON COMMIT DROP");
+
+		auto stream = pqxx::stream_to::table(tx, { "import_stand" }, { "tijd", "teller_id", "stand" });
+
+		char sep = ',';
+		std::vector<int> tellers;
+		size_t regel_nr = 0;
+
+		for (auto regel : split_csv(csv, '\n'))
+		{
+			++regel_nr;
+
+			if (not regel.empty() and regel.back() == '\r')
+				regel.remove_suffix(1);
+
+			if (regel.empty())
+				continue;
+
+			if (tellers.empty())
+			{
+				if (regel.find(';') != std::string_view::npos)
+					sep = ';';
+
+				auto kolommen = split_csv(regel, sep);
+				if (kolommen.size() < 2 or kolommen.front() != "tijd")
+					throw std::runtime_error("De eerste regel moet de kolommen bevatten: tijd gevolgd door teller id's");
+
+				for (auto k = kolommen.begin() + 1; k != kolommen.end(); ++k)
+					tellers.push_back(std::stoi(std::string{ *k }));
+
+				continue;
+			}
+
+			auto velden = split_csv(regel, sep);
+			if (velden.size() > tellers.size() + 1)
+				throw std::runtime_error("Te veel kolommen op regel " + std::to_string(regel_nr));
+
+			auto tijd = parse_import_tijd(velden.front());
+			if (not tijd)
+				throw std::runtime_error("Ongeldige tijd op regel " + std::to_string(regel_nr));
+
+			for (size_t i = 1; i < velden.size(); ++i)
+			{
+				std::string veld{ velden[i] };
+				if (veld.empty())
+					continue;
+
+				if (sep == ';')
+					std::replace(veld.begin(), veld.end(), ',', '.');
+
+				stream.write_values(*tijd, tellers[i - 1], veld);
+			}
+		}
+
+		stream.complete();
+
+		auto r = tx.exec1(
+			"WITH o AS ("
+			"   INSERT INTO opname (tijd)"
+			"   SELECT DISTINCT tijd FROM import_stand WHERE tijd NOT IN (SELECT tijd FROM opname)"
+			"   RETURNING id, tijd),"
+			" s AS ("
+			"   INSERT INTO tellerstand (opname_id, teller_id, stand)"
+			"   SELECT o.id, i.teller_id, i.stand FROM o JOIN import_stand i ON i.tijd = o.tijd)"
+			" SELECT COUNT(*) FROM o");
+
+		tx.commit();
+
+		invalidate_stand_maps();
+
+		return r[0].as<int>();
+	}
+
 	void put_opname(std::string opnameId, Opname opname)
 	{
-		pqxx::work tx(get_connection());
+		auto [tellers, standen] = as_arrays(opname.standen);
+
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::work tx(*connection);
 
-		for (auto stand : opname.standen)
-			tx.exec_prepared("update-stand", stand.second, opnameId, stol(stand.first));
+		MeetTijd meting(*mUpdateStandTijd);
+		tx.exec_prepared("update-stand", opnameId, tellers, standen);
 
 		tx.commit();
+
+		invalidate_stand_maps();
 	}
 
 	Opname get_opname(std::string id)
 	{
-		pqxx::work tx(get_connection());
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::work tx(*connection);
+		MeetTijd meting(*mGetOpnameTijd);
 		auto rows = tx.exec_prepared("get-opname", id);
 
 		if (rows.empty())
@@ -315,14 +588,16 @@ class DataService
 		Opname result{ rows.front()[0].as<std::string>(), makeTimePoint(rows.front()[1].as<std::string>()) };
 
 		for (auto row : rows)
-			result.standen[row[2].as<std::string>()] = row[3].as<float>();
+			result.standen.set(row[2].as<int>(), row[3].as<float>());
 
 		return result;
 	}
 
 	Opname get_last_opname()
 	{
-		pqxx::work tx(get_connection());
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::work tx(*connection);
+		MeetTijd meting(*mGetLastOpnameTijd);
 		auto rows = tx.exec_prepared("get-last-opname");
 
 		if (rows.empty())
@@ -331,18 +606,24 @@ class DataService
 		Opname result{ rows.front()[0].as<std::string>(), makeTimePoint(rows.front()[1].as<std::string>()) };
 
 		for (auto row : rows)
-			result.standen[row[2].as<std::string>()] = row[3].as<float>();
+			result.standen.set(row[2].as<int>(), row[3].as<float>());
 
 		return result;
 	}
 
-	std::vector<Opname> get_all_opnames()
+	// Returns at most limiet opnames taken before voor, most recent
+	// first. Use the datum and id of the last one to fetch the next page,
+	// the id separates opnames taken at the same time.
+	std::vector<Opname> get_opnames(std::optional<std::chrono::system_clock::time_point> voor, int voor_id, int limiet)
 	{
 		std::vector<Opname> result;
 
-		pqxx::work tx(get_connection());
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::work tx(*connection);
 
-		auto rows = tx.exec_prepared("get-opname-all");
+		MeetTijd meting(*mGetOpnamePaginaTijd);
+		auto rows = tx.exec_prepared("get-opname-pagina",
+			voor ? date::format("%F %T", date::floor<std::chrono::microseconds>(*voor)) : "infinity", voor_id, limiet);
 		for (auto row : rows)
 		{
 			auto id = row[0].as<std::string>();
@@ -350,7 +631,7 @@ class DataService
 			if (result.empty() or result.back().id != id)
 				result.push_back({ id, makeTimePoint(row[1].as<std::string>()) });
 
-			result.back().standen[row[2].as<std::string>()] = row[3].as<float>();
+			result.back().standen.set(row[2].as<int>(), row[3].as<float>());
 		}
 
 		return result;
@@ -358,65 +639,406 @@ class DataService
 
 	void delete_opname(std::string id)
 	{
-		pqxx::work tx(get_connection());
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::work tx(*connection);
+		MeetTijd meting(*mDelOpnameTijd);
 		tx.exec_prepared("del-opname", id);
 		tx.commit();
+
+		invalidate_stand_maps();
 	}
 
 	std::vector<Teller> get_tellers()
 	{
-		std::vector<Teller> result;
+		return get_teller_gegevens()->tellers;
+	}
 
-		pqxx::work tx(get_connection());
+	// The teller table practically never changes, it is cached until
+	// invalidate_tellers is called. That happens automatically when the
+	// database sends a teller_gewijzigd notification.
+	std::shared_ptr<const TellerGegevens> get_teller_gegevens()
+	{
+		std::unique_lock lock(mMutex);
 
-		auto rows = tx.exec_prepared("get-tellers-all");
-		for (auto row : rows)
-		{
-			auto c1 = row.column_number("id");
-			auto c2 = row.column_number("naam");
-			auto c3 = row.column_number("naam_kort");
-			auto c4 = row.column_number("schaal");
+		if (mTellers)
+			return mTellers;
+
+		auto generatie = mTellerGeneratie;
+		lock.unlock();
 
-			result.push_back({ row[c1].as<std::string>(), row[c2].as<std::string>(), row[c3].as<std::string>(), row[c4].as<int>() });
+		auto result = std::make_shared<TellerGegevens>();
+
+		{
+			auto connection = ConnectionPool::instance().borrow();
+			pqxx::work tx(*connection);
+
+			MeetTijd meting(*mGetTellersAllTijd);
+			auto rows = tx.exec_prepared("get-tellers-all");
+			for (auto row : rows)
+			{
+				auto c1 = row.column_number("id");
+				auto c2 = row.column_number("naam");
+				auto c3 = row.column_number("naam_kort");
+				auto c4 = row.column_number("schaal");
+				auto c5 = row.column_number("teken");
+
+				result->tellers.push_back({ row[c1].as<std::string>(), row[c2].as<std::string>(), row[c3].as<std::string>(), row[c4].as<int>() });
+
+				if (not row[c5].is_null())
+					result->teken[row[c1].as<int>()] = row[c5].as<int>();
+			}
 		}
 
+		to_element(result->json, result->tellers);
+
+		lock.lock();
+
+		if (generatie == mTellerGeneratie)
+			mTellers = result;
+
 		return result;
 	}
 
-	StandMap get_stand_map(grafiek_type type)
+	void invalidate_tellers()
+	{
+		std::unique_lock lock(mMutex);
+
+		mTellers.reset();
+		++mTellerGeneratie;
+	}
+
+	// The series are cached, a cached series is never modified so it
+	// can be used after the lock is released.
+	std::shared_ptr<const StandMap> get_stand_map(grafiek_type type)
 	{
-		pqxx::work tx(get_connection());
+		std::unique_lock lock(mMutex);
+
+		if (auto i = mStandMaps.find(type); i != mStandMaps.end())
+			return i->second;
+
+		auto generatie = mGeneratie;
+		lock.unlock();
+
+		// all series are loaded at once, concurrent callers for the same
+		// generation wait for a single load
+		auto standMaps = mLaadStandMaps.voer_uit(generatie, [this]()
+			{ return load_stand_maps(); });
 
-		StandMap sm;
+		lock.lock();
 
-		for (auto r : tx.exec(selector(type)))
-			sm[makeTimePoint(r[0].as<std::string>())] = r[1].as<float>();
+		// do not store the result when the data changed while loading
+		if (generatie == mGeneratie)
+			mStandMaps = *standMaps;
 
-		return sm;
+		return standMaps->at(type);
 	}
 
-	void reset()
+	// The graph data for the current year, computed for all series and
+	// aggregations in parallel when one of them is missing.
+	std::shared_ptr<const std::vector<DataPunt>> get_grafiek(grafiek_type type, aggregatie_type aggr)
 	{
-		sConnection.reset();
+		std::shared_future<void> voorberekening;
+
+		{
+			std::unique_lock lock(mMutex);
+
+			if (auto result = zoek_grafiek(type, aggr))
+				return result;
+
+			if (not mVoorberekening.valid() or mVoorberekening.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready)
+				mVoorberekening = std::async(std::launch::async, &DataService::bereken_alle_grafieken, this).share();
+
+			voorberekening = mVoorberekening;
+		}
+
+		voorberekening.wait();
+
+		return bereken_grafiek(type, aggr);
+	}
+
+	void invalidate_stand_maps()
+	{
+		std::unique_lock lock(mMutex);
+
+		mStandMaps.clear();
+		mGrafieken.clear();
+		++mGeneratie;
+	}
+
+	~DataService()
+	{
+		mStop = true;
+
+		if (mListener.joinable())
+			mListener.join();
 	}
 
   private:
-	DataService(const std::string &dbConnectString);
+	DataService();
+
+	// Listens for changes to the teller table on a dedicated connection.
+	// Notifications sent while not connected are missed, so the cache is
+	// dropped after each (re)connect.
+	void listen()
+	{
+		class Ontvanger : public pqxx::notification_receiver
+		{
+		  public:
+			Ontvanger(pqxx::connection &connection, DataService &service)
+				: pqxx::notification_receiver(connection, "teller_gewijzigd")
+				, m_service(service)
+			{
+			}
+
+			void operator()(const std::string &, int) override
+			{
+				m_service.invalidate_tellers();
+			}
+
+		  private:
+			DataService &m_service;
+		};
+
+		while (not mStop)
+		{
+			try
+			{
+				pqxx::connection connection(ConnectionPool::instance().get_connection_string());
+				Ontvanger ontvanger(connection, *this);
+
+				invalidate_tellers();
+
+				// The database is reachable, open the first connection of
+				// the pool now instead of in the first request
+				ConnectionPool::instance().borrow();
+				Gezondheid::instance().meld("databank", Toestand::gereed);
+
+				while (not mStop)
+					connection.await_notification(1, 0);
+			}
+			catch (const std::exception &ex)
+			{
+				std::cerr << "Luisteren naar wijzigingen in tellers mislukt: " << ex.what() << std::endl;
+				Gezondheid::instance().meld("databank", Toestand::fout, ex.what());
+
+				for (int i = 0; i < 30 and not mStop; ++i)
+					std::this_thread::sleep_for(std::chrono::seconds(1));
+			}
+		}
+	}
+
+	// Reads all readings once and derives every series from them
+	std::map<grafiek_type, std::shared_ptr<const StandMap>> load_stand_maps()
+	{
+		constexpr size_t N = std::size(kReeksen);
+
+		std::map<int, std::vector<size_t>> reeksenVoorTeller;
+		for (size_t i = 0; i < N; ++i)
+		{
+			for (auto teller : kReeksen[i].tellers)
+				reeksenVoorTeller[teller].push_back(i);
+		}
+
+		std::vector<StandMap> standMaps(N);
+		std::vector<double> som(N, 0);
+		std::vector<bool> gevonden(N, false);
+		std::string tijd;
+
+		auto voegToe = [&]()
+		{
+			auto t = makeTimePoint(tijd);
+
+			for (size_t i = 0; i < N; ++i)
+			{
+				if (gevonden[i])
+					standMaps[i].insert(t, static_cast<float>(som[i]));
+
+				som[i] = 0;
+				gevonden[i] = false;
+			}
+		};
+
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::work tx(*connection);
+
+		MeetTijd meting(*mGetStandenAllTijd);
+		for (auto r : tx.exec_prepared("get-standen-all"))
+		{
+			if (auto t = r[0].as<std::string>(); t != tijd)
+			{
+				if (not tijd.empty())
+					voegToe();
+				tijd = t;
+			}
+
+			if (r[2].is_null())
+				continue;
+
+			auto stand = r[2].as<double>();
+
+			for (auto i : reeksenVoorTeller[r[1].as<int>()])
+			{
+				if (not kReeksen[i].met_teken)
+					som[i] += stand;
+				else if (not r[3].is_null())
+					som[i] += r[3].as<int>() * stand;
+				else
+					continue;
+
+				gevonden[i] = true;
+			}
+		}
+
+		if (not tijd.empty())
+			voegToe();
+
+		std::map<grafiek_type, std::shared_ptr<const StandMap>> result;
+		for (size_t i = 0; i < N; ++i)
+			result.emplace(kReeksen[i].type, std::make_shared<const StandMap>(std::move(standMaps[i])));
+
+		return result;
+	}
+
+	// Add a new reading to the cached series instead of reloading them
+	void append_stand(std::chrono::system_clock::time_point tijd, const Standen &standen)
+	{
+		{
+			std::unique_lock lock(mMutex);
+
+			mGrafieken.clear();
 
-	pqxx::connection &get_connection();
+			if (mStandMaps.empty())
+			{
+				++mGeneratie;
+				return;
+			}
+		}
+
+		auto gegevens = get_teller_gegevens();
+		auto &teken = gegevens->teken;
+
+		std::unique_lock lock(mMutex);
+
+		for (auto &[type, sm] : mStandMaps)
+		{
+			auto &reeks = *std::find_if(std::begin(kReeksen), std::end(kReeksen), [type = type](const ReeksDefinitie &r)
+				{ return r.type == type; });
+
+			bool gevonden = false;
+			double som = 0;
+
+			for (auto teller : reeks.tellers)
+			{
+				auto stand = standen.get(teller);
+				if (not stand)
+					continue;
+
+				if (not reeks.met_teken)
+					som += *stand;
+				else if (auto t = teken.find(teller); t != teken.end())
+					som += t->second * *stand;
+				else
+					continue;
+
+				gevonden = true;
+			}
+
+			if (not gevonden)
+				continue;
+
+			auto nieuw = std::make_shared<StandMap>(*sm);
+			nieuw->insert(tijd, static_cast<float>(som));
+			sm = std::move(nieuw);
+		}
+
+		mGrafieken.clear();
+		++mGeneratie;
+	}
+
+	// Returns the cached graph, if it is still valid. mMutex must be locked
+	std::shared_ptr<const std::vector<DataPunt>> zoek_grafiek(grafiek_type type, aggregatie_type aggr)
+	{
+		auto vandaag = date::floor<date::days>(std::chrono::system_clock::now());
+
+		if (auto i = mGrafieken.find({ type, aggr }); i != mGrafieken.end() and std::get<0>(i->second) == vandaag)
+			return std::get<1>(i->second);
+
+		return {};
+	}
+
+	std::shared_ptr<const std::vector<DataPunt>> bereken_grafiek(grafiek_type type, aggregatie_type aggr)
+	{
+		std::unique_lock lock(mMutex);
 
-	std::string mConnectString;
+		if (auto result = zoek_grafiek(type, aggr))
+			return result;
+
+		auto generatie = mGeneratie;
+		lock.unlock();
+
+		auto vandaag = date::floor<date::days>(std::chrono::system_clock::now());
+		auto result = std::make_shared<const std::vector<DataPunt>>(::bereken_grafiek(*get_stand_map(type), aggr, vandaag));
+
+		lock.lock();
+
+		if (generatie == mGeneratie)
+			mGrafieken[{ type, aggr }] = { vandaag, result };
+
+		return result;
+	}
+
+	// Loads the series once and then computes the graphs for each series
+	// on a separate thread
+	void bereken_alle_grafieken()
+	{
+		try
+		{
+			get_stand_map(grafiek_type::warmte);
+
+			std::vector<std::future<void>> taken;
+
+			for (auto &reeks : kReeksen)
+			{
+				taken.emplace_back(std::async(std::launch::async, [this, type = reeks.type]()
+					{
+						for (auto aggr : { aggregatie_type::dag, aggregatie_type::week, aggregatie_type::maand, aggregatie_type::jaar })
+							bereken_grafiek(type, aggr); }));
+			}
+
+			for (auto &taak : taken)
+				taak.get();
+		}
+		catch (const std::exception &ex)
+		{
+			std::cerr << "Fout bij berekenen grafieken: " << ex.what() << std::endl;
+		}
+	}
+
+	std::mutex mMutex;
+	std::map<grafiek_type, std::shared_ptr<const StandMap>> mStandMaps;
+	std::map<std::tuple<grafiek_type, aggregatie_type>, std::tuple<date::sys_days, std::shared_ptr<const std::vector<DataPunt>>>> mGrafieken;
+	std::shared_future<void> mVoorberekening;
+	uint32_t mGeneratie = 0;
+	SingleFlight<uint32_t, std::map<grafiek_type, std::shared_ptr<const StandMap>>> mLaadStandMaps;
+
+	std::shared_ptr<const TellerGegevens> mTellers;
+	uint32_t mTellerGeneratie = 0;
+
+	// The latency histograms of the prepared statements
+	Histogram *mGetOpnamePaginaTijd, *mGetOpnameTijd, *mGetLastOpnameTijd, *mInsertOpnameTijd,
+		*mUpdateStandTijd, *mDelOpnameTijd, *mGetTellersAllTijd, *mGetStandenAllTijd;
+
+	std::atomic<bool> mStop{ false };
+	std::thread mListener;
 
 	static std::unique_ptr<DataService> sInstance;
-	static thread_local std::unique_ptr<pqxx::connection> sConnection;
 };
 
 std::unique_ptr<DataService> DataService::sInstance;
-thread_local std::unique_ptr<pqxx::connection> DataService::sConnection;
 
-void DataService::init(const std::string &dbConnectString)
+void DataService::init()
 {
-	sInstance.reset(new DataService(dbConnectString));
+	sInstance.reset(new DataService());
 }
 
 DataService &DataService::instance()
@@ -424,65 +1046,101 @@ DataService &DataService::instance()
 	return *sInstance;
 }
 
-pqxx::connection &DataService::get_connection()
+void DataService::stop()
 {
-	if (not sConnection)
-	{
-		sConnection.reset(new pqxx::connection(mConnectString));
-
-		sConnection->prepare("get-opname-all",
-			"SELECT a.id AS id, a.tijd AS tijd, b.teller_id AS teller_id, b.stand AS stand"
-			" FROM opname a, tellerstand b"
-			" WHERE a.id = b.opname_id"
-			" ORDER BY a.tijd DESC");
-
-		sConnection->prepare("get-opname",
-			"SELECT a.id AS id, a.tijd AS tijd, b.teller_id AS teller_id, b.stand AS stand"
-			" FROM opname a, tellerstand b"
-			" WHERE a.id = b.opname_id AND a.id = $1");
-
-		sConnection->prepare("get-last-opname",
-			"SELECT a.id AS id, a.tijd AS tijd, b.teller_id AS teller_id, b.stand AS stand"
-			" FROM opname a, tellerstand b"
-			" WHERE a.id = b.opname_id AND a.id = (SELECT MAX(id) FROM opname)");
-
-		sConnection->prepare("insert-opname", "INSERT INTO opname DEFAULT VALUES RETURNING id");
-		sConnection->prepare("insert-stand", "INSERT INTO tellerstand (opname_id, teller_id, stand) VALUES($1, $2, $3);");
-
-		sConnection->prepare("update-stand", "UPDATE tellerstand SET stand = $1 WHERE opname_Id = $2 AND teller_id = $3;");
-
-		sConnection->prepare("del-opname", "DELETE FROM opname WHERE id=$1");
-
-		sConnection->prepare("get-tellers-all",
-			"SELECT id, naam, naam_kort, schaal FROM teller ORDER BY id");
-	}
-	return *sConnection;
+	sInstance.reset();
 }
 
-DataService::DataService(const std::string &dbConnectString)
-	: mConnectString(dbConnectString)
+DataService::DataService()
 {
+	auto &pool = ConnectionPool::instance();
+
+	mGetOpnamePaginaTijd = &pool.prepare("get-opname-pagina",
+		"SELECT a.id AS id, a.tijd AS tijd, b.teller_id AS teller_id, b.stand AS stand"
+		" FROM (SELECT id, tijd FROM opname WHERE (tijd, id) < ($1, $2) ORDER BY tijd DESC, id DESC LIMIT $3) a, tellerstand b"
+		" WHERE a.id = b.opname_id"
+		" ORDER BY a.tijd DESC, a.id DESC");
+
+	mGetOpnameTijd = &pool.prepare("get-opname",
+		"SELECT a.id AS id, a.tijd AS tijd, b.teller_id AS teller_id, b.stand AS stand"
+		" FROM opname a, tellerstand b"
+		" WHERE a.id = b.opname_id AND a.id = $1");
+
+	mGetLastOpnameTijd = &pool.prepare("get-last-opname",
+		"SELECT a.id AS id, a.tijd AS tijd, b.teller_id AS teller_id, b.stand AS stand"
+		" FROM opname a, tellerstand b"
+		" WHERE a.id = b.opname_id AND a.id = (SELECT MAX(id) FROM opname)");
+
+	mInsertOpnameTijd = &pool.prepare("insert-opname",
+		"WITH o AS (INSERT INTO opname DEFAULT VALUES RETURNING id, tijd),"
+		" s AS (INSERT INTO tellerstand (opname_id, teller_id, stand)"
+		"       SELECT o.id, t.teller_id, t.stand FROM o, unnest($1::integer[], $2::numeric[]) AS t(teller_id, stand))"
+		" SELECT id, tijd FROM o");
+
+	mUpdateStandTijd = &pool.prepare("update-stand",
+		"UPDATE tellerstand s SET stand = t.stand"
+		" FROM unnest($2::integer[], $3::numeric[]) AS t(teller_id, stand)"
+		" WHERE s.opname_id = $1 AND s.teller_id = t.teller_id");
+
+	mDelOpnameTijd = &pool.prepare("del-opname", "DELETE FROM opname WHERE id=$1");
+
+	mGetTellersAllTijd = &pool.prepare("get-tellers-all",
+		"SELECT id, naam, naam_kort, schaal, teken FROM teller ORDER BY id");
+
+	mGetStandenAllTijd = &pool.prepare("get-standen-all",
+		"SELECT a.tijd, b.teller_id, b.stand, c.teken"
+		" FROM opname a JOIN tellerstand b ON a.id = b.opname_id LEFT OUTER JOIN teller c ON b.teller_id = c.id"
+		" ORDER BY a.tijd ASC");
+
+	mListener = std::thread(std::bind(&DataService::listen, this));
 }
 
 // --------------------------------------------------------------------
 
+// The latency histogram of an ajax route
+Histogram &request_histogram(const std::string &route, const std::string &method)
+{
+	return Metrieken::instance().histogram("energyd_http_request_seconds", "Time to handle an ajax request",
+		{ { "route", route }, { "method", method } });
+}
+
 class e_rest_controller : public zeep::http::rest_controller
 {
   public:
 	e_rest_controller()
 		: zeep::http::rest_controller("ajax")
+		, m_compressie_drempel(mcfp::config::instance().get<size_t>("compressie-drempel"))
+		, m_onbekend_tijd(request_histogram("onbekend", "onbekend"))
 	{
-		map_post_request("opname", &e_rest_controller::post_opname, "opname");
-		map_put_request("opname/{id}", &e_rest_controller::put_opname, "id", "opname");
-		map_get_request("opname/{id}", &e_rest_controller::get_opname, "id");
-		map_get_request("opname", &e_rest_controller::get_all_opnames);
-		map_delete_request("opname/{id}", &e_rest_controller::delete_opname, "id");
+		// the mapped routes are also the labels of the request metrics,
+		// their histograms are looked up once here
+		auto route = [this](const char *method, const char *pad)
+		{
+			m_routes.insert(pad);
+			m_request_tijd.emplace(std::make_tuple(pad, method), &request_histogram(pad, method));
+			return pad;
+		};
+
+		map_post_request(route("POST", "opname"), &e_rest_controller::post_opname, "opname");
+		map_post_request(route("POST", "opname/import"), &e_rest_controller::import_opnames, "csv");
+		map_put_request(route("PUT", "opname/{id}"), &e_rest_controller::put_opname, "id", "opname");
+		map_get_request(route("GET", "opname/{id}"), &e_rest_controller::get_opname, "id");
+		map_get_request(route("GET", "opname"), &e_rest_controller::get_opnames, "voor", "voor_id", "limiet");
+		map_delete_request(route("DELETE", "opname/{id}"), &e_rest_controller::delete_opname, "id");
 
-		map_get_request("data/{type}/{aggr}", &e_rest_controller::get_grafiek, "type", "aggr");
+		map_get_request(route("GET", "data/{type}/{aggr}"), &e_rest_controller::get_grafiek, "type", "aggr", "formaat");
 
-		map_get_request("grafiek/{tijdstip}", &e_rest_controller::get_grafiek_punt, "tijdstip", "resolutie");
+		map_get_request(route("GET", "grafiek/{tijdstip}"), &e_rest_controller::get_grafiek_punt, "tijdstip", "resolutie", "formaat", "since");
+		map_get_request(route("GET", "grafiek"), &e_rest_controller::get_grafiek_periode, "van", "tot", "resolutie");
+
+		map_get_request(route("GET", "status/schrijver"), &e_rest_controller::get_schrijver_status);
 	}
 
+	bool handle_request(zeep::http::request &req, zeep::http::reply &rep) override;
+
+	// The actual handling, compression and conditional GET
+	bool verwerk_request(zeep::http::request &req, zeep::http::reply &rep);
+
 	// CRUD routines
 	std::string post_opname(Opname opname)
 	{
@@ -494,6 +1152,11 @@ class e_rest_controller : public zeep::http::rest_controller
 		DataService::instance().put_opname(opnameId, opname);
 	}
 
+	int import_opnames(const zeep::http::file_param &csv)
+	{
+		return DataService::instance().import_opnames({ csv.data, csv.length });
+	}
+
 	Opname get_opname(std::string id)
 	{
 		return DataService::instance().get_opname(id);
@@ -504,9 +1167,15 @@ class e_rest_controller : public zeep::http::rest_controller
 		return DataService::instance().get_last_opname();
 	}
 
-	std::vector<Opname> get_all_opnames()
+	// Without voor_id all opnames taken at voor are skipped
+	std::vector<Opname> get_opnames(std::optional<std::string> voor, std::optional<int> voor_id, std::optional<int> limiet)
 	{
-		return DataService::instance().get_all_opnames();
+		std::optional<std::chrono::system_clock::time_point> t;
+		if (voor)
+			t = makeTimePointFromJSON(*voor);
+
+		return DataService::instance().get_opnames(t, voor_id.value_or(0),
+			std::clamp(limiet.value_or(kOpnamesPerPagina), 1, kMaxOpnamesPerPagina));
 	}
 
 	void delete_opname(std::string id)
@@ -519,155 +1188,395 @@ class e_rest_controller : public zeep::http::rest_controller
 		return DataService::instance().get_tellers();
 	}
 
-	std::vector<GrafiekPunt> get_grafiek_punt(date::sys_days tijd, std::optional<int> resolutie)
+	zeep::http::reply get_grafiek_punt(date::sys_days tijd, std::optional<int> resolutie, std::optional<std::string> formaat,
+		std::optional<std::string> since)
 	{
 		const auto ymd = date::year_month_day{ tijd };
-		return DataService_v2::instance().grafiekVoorDag(ymd, std::chrono::minutes{ resolutie.value_or(2) });
+
+		if (since)
+			return get_grafiek_update(ymd, std::chrono::minutes{ resolutie.value_or(2) }, is_kolommen(formaat), makeTimePointFromJSON(*since));
+
+		auto data = GrafiekCache::instance().get(ymd, std::chrono::minutes{ resolutie.value_or(2) }, is_kolommen(formaat));
+
+		auto rep = zeep::http::reply::stock_reply(zeep::http::ok);
+		rep.set_content(data->json, "application/json");
+		rep.set_header("ETag", data->etag);
+		rep.set_header("Cache-Control", "no-cache");
+		return rep;
+	}
+
+	// Only the points at or after since, the client replaces the points
+	// it has from that time on. This is cheap, so it is not cached.
+	zeep::http::reply get_grafiek_update(date::year_month_day ymd, std::chrono::minutes resolutie, bool kolommen,
+		std::chrono::system_clock::time_point since)
+	{
+		auto &service = DataService_v2::instance();
+		auto data = service.grafiekVoorDag(ymd, resolutie, since);
+
+		auto rep = zeep::http::reply::stock_reply(zeep::http::ok);
+
+		if (kolommen)
+		{
+			auto stap = std::max<std::chrono::seconds>(resolutie, service.get_interval());
+			auto start = data.empty() ? since : data.front().tijd;
+			rep.set_content(grafiek_kolommen(data, start, stap), "application/json");
+		}
+		else
+		{
+			zeep::json::element e;
+			to_element(e, data);
+			rep.set_content(e);
+		}
+
+		rep.set_header("Cache-Control", "no-store");
+		return rep;
+	}
+
+	zeep::http::reply get_grafiek_periode(date::sys_days van, date::sys_days tot, std::optional<int> resolutie)
+	{
+		auto data = DataService_v2::instance().grafiekVoorPeriode(date::year_month_day{ van }, date::year_month_day{ tot },
+			std::chrono::minutes{ resolutie.value_or(2) });
+
+		auto rep = zeep::http::reply::stock_reply(zeep::http::ok);
+		rep.set_content(data.release(), "application/json");
+		return rep;
 	}
 
-	// GrafiekData get_grafiek(const string& type, aggregatie_type aggregatie);
-	std::vector<DataPunt> get_grafiek(grafiek_type type, aggregatie_type aggregatie);
+	SchrijverStatus get_schrijver_status()
+	{
+		return DataService_v2::instance().get_schrijver_status();
+	}
+
+	zeep::http::reply get_grafiek(grafiek_type type, aggregatie_type aggregatie, std::optional<std::string> formaat);
+
+	// The optional formaat parameter selects between the default array of
+	// objects and the columnar format
+	static bool is_kolommen(const std::optional<std::string> &formaat)
+	{
+		if (not formaat or *formaat == "objecten")
+			return false;
+		if (*formaat == "kolommen")
+			return true;
+		throw std::runtime_error("Onbekend formaat " + *formaat);
+	}
+
+  private:
+	// Replies of at least this size are compressed, 0 disables compression
+	size_t m_compressie_drempel;
+
+	std::set<std::string> m_routes;
+
+	// The request histograms by route and method, only filled by the constructor
+	std::map<std::tuple<std::string, std::string>, Histogram *> m_request_tijd;
+	Histogram &m_onbekend_tijd;
+
+	// The reply of the base handler, shared by concurrent identical GET requests
+	struct GedeeldAntwoord
+	{
+		bool afgehandeld;
+		zeep::http::reply reply;
+	};
+
+	SingleFlight<std::string, GedeeldAntwoord> m_single_flight{ kMaxWachtGedeeld };
 };
 
 // --------------------------------------------------------------------
 
-float interpolateStand(const StandMap &data, std::chrono::system_clock::time_point t)
+bool etag_matches(const std::string &if_none_match, const std::string &etag)
 {
-	float result = 0;
+	std::string::size_type b = 0;
 
-	for (;;)
+	while (b < if_none_match.length())
 	{
-		if (data.empty())
-			break;
+		auto e = if_none_match.find(',', b);
+		if (e == std::string::npos)
+			e = if_none_match.length();
 
-		auto ub = data.upper_bound(t);
-		if (ub == data.end())
-		{
-			result = prev(ub)->second;
-			break;
-		}
+		auto tag = if_none_match.substr(b, e - b);
+		b = e + 1;
 
-		if (ub == data.begin())
-		{
-			result = ub->second;
-			break;
-		}
+		while (not tag.empty() and tag.front() == ' ')
+			tag.erase(0, 1);
+		while (not tag.empty() and tag.back() == ' ')
+			tag.pop_back();
+
+		if (tag.starts_with("W/"))
+			tag.erase(0, 2);
+
+		if (tag == etag or tag == "*")
+			return true;
+	}
+
+	return false;
+}
 
-		auto b = prev(ub);
-		assert(b->first <= t);
+// The mapped route matching path, for use as a metric label. A {name}
+// segment in a route matches any segment. Paths that match none of the
+// routes all get the label onbekend, a client cannot add series.
+std::string route_label(const std::set<std::string> &routes, const std::string &path)
+{
+	auto segmenten = split_csv(path, '/');
 
-		double d1 = (ub->first - b->first).count();
-		double d2 = (t - b->first).count();
+	for (auto &route : routes)
+	{
+		auto patroon = split_csv(route, '/');
 
-		auto df = ub->second - b->second;
+		if (patroon.size() != segmenten.size())
+			continue;
 
-		result = b->second + df * (d2 / d1);
+		bool match = true;
+		for (size_t i = 0; match and i < patroon.size(); ++i)
+			match = patroon[i] == segmenten[i] or (patroon[i].starts_with('{') and patroon[i].ends_with('}'));
 
-		break;
+		if (match)
+			return route;
 	}
 
+	return "onbekend";
+}
+
+bool e_rest_controller::handle_request(zeep::http::request &req, zeep::http::reply &rep)
+{
+	TraceSpan span("http", "ajax");
+
+	auto start = std::chrono::steady_clock::now();
+
+	bool result = verwerk_request(req, rep);
+
+	// Requests not handled by one of the routes share one label, to keep
+	// the number of series bounded. The method is then unknown as well.
+	Histogram *tijd = &m_onbekend_tijd;
+	if (result and rep.get_status() != zeep::http::not_found)
+	{
+		auto i = m_request_tijd.find({ route_label(m_routes, get_prefixless_path(req)), req.get_method() });
+		if (i != m_request_tijd.end())
+			tijd = i->second;
+	}
+
+	tijd->observe(std::chrono::steady_clock::now() - start);
+
 	return result;
 }
 
-float interpoleerVerbruik(const StandMap &data, std::chrono::system_clock::time_point t, aggregatie_type aggr)
+// The reply when the executor is saturated, or a shared reply took too long
+bool antwoord_bezet(zeep::http::reply &rep)
 {
-	using namespace date;
-	using namespace std::chrono;
-	using namespace std::literals;
+	rep = zeep::http::reply::stock_reply(zeep::http::service_unavailable);
+	rep.set_header("Retry-After", "1");
+	return true;
+}
 
-	auto t1 = t, t2 = t;
+bool e_rest_controller::verwerk_request(zeep::http::request &req, zeep::http::reply &rep)
+{
+	bool result;
 
-	if (t1 > prev(data.end())->first)
-		t1 = prev(data.end())->first;
+	// Identical GET requests that arrive while one is being handled wait
+	// for it and share its reply. The grafiek route streams its reply, a
+	// stream can only be sent once.
+	auto path = get_prefixless_path(req);
 
-	switch (aggr)
+	// The handlers query the database, they run on the bounded executor
+	// so a burst of slow queries cannot occupy all server threads. Only
+	// the request that does the work takes a slot of the executor,
+	// requests waiting for its reply wait a limited time on their own.
+	try
 	{
-		case aggregatie_type::dag:
-			t2 -= date::days{ 1 };
-			break;
-		case aggregatie_type::week:
-			t2 -= date::weeks{ 1 };
-			break;
-		case aggregatie_type::maand:
-			t2 -= date::months{ 1 };
-			break;
-		case aggregatie_type::jaar:
-			t2 -= date::years{ 1 };
-			break;
+		if (req.get_method() == "GET" and path != "grafiek")
+		{
+			auto sleutel = path;
+			for (auto &[naam, waarde] : req.get_parameters())
+				sleutel += '\n' + naam + '=' + waarde;
+
+			bool gedeeld;
+			auto antwoord = m_single_flight.voer_uit(sleutel, [this, &req]()
+				{ return Uitvoerder::instance().voer_uit([this, &req]()
+					{
+					GedeeldAntwoord result{};
+					result.afgehandeld = zeep::http::rest_controller::handle_request(req, result.reply);
+					return result; }); }, &gedeeld);
+
+			if (gedeeld)
+			{
+				static auto &s_gedeeld = Metrieken::instance().teller("energyd_http_coalesced_total",
+					"Ajax requests that shared the reply of an identical request in progress");
+				s_gedeeld.inc();
+			}
+
+			result = antwoord->afgehandeld;
+			rep = antwoord->reply;
+		}
+		else
+			result = Uitvoerder::instance().voer_uit([this, &req, &rep]()
+				{ return zeep::http::rest_controller::handle_request(req, rep); });
+	}
+	catch (const Verzadigd &)
+	{
+		return antwoord_bezet(rep);
 	}
+	catch (const WachtenVerlopen &)
+	{
+		return antwoord_bezet(rep);
+	}
+
+	if (not result or rep.get_status() != zeep::http::ok)
+		return result;
 
-	if (t2 > t1)
-		t2 = t1;
+	// Compress large replies when the client accepts it. Streamed replies
+	// have no content here and are sent as is.
+	const std::string &content = rep.get_content();
 
-	float result = 0;
+	bool comprimeren = m_compressie_drempel > 0 and content.length() >= m_compressie_drempel and
+	                   rep.get_header("Content-Encoding").empty();
 
-	if (t1 > t2)
+	auto codering = comprimeren ? kies_codering(req.get_header("Accept-Encoding")) : Codering::geen;
+
+	// The compressed reply is a different representation, so it gets its own ETag
+	auto etag = rep.get_header("ETag");
+	if (not etag.empty() and codering != Codering::geen)
+		etag = etag.substr(0, etag.length() - 1) + '-' + codering_naam(codering) + '"';
+
+	// Conditional GET, replies that carry an ETag can be answered with a 304
+	if (not etag.empty() and etag_matches(req.get_header("If-None-Match"), etag))
 	{
-		float s1 = interpolateStand(data, t1);
-		float s2 = interpolateStand(data, t2);
-		result = (24 * 60 * 60) * (s1 - s2) / floor<std::chrono::seconds>(t1 - t2).count();
+		rep = zeep::http::reply(zeep::http::not_modified);
+		rep.set_header("ETag", etag);
+		rep.set_header("Cache-Control", "no-cache");
+		if (comprimeren)
+			rep.set_header("Vary", "Accept-Encoding");
 	}
+	else if (codering != Codering::geen)
+	{
+		auto content_type = rep.get_header("Content-Type");
+
+		if (etag.empty())
+			rep.set_content(comprimeer(content, codering), content_type);
+		else
+		{
+			auto data = CompressieCache::instance().get(etag, codering, content);
+			rep.set_content(*data, content_type);
+			rep.set_header("ETag", etag);
+		}
+
+		rep.set_header("Content-Encoding", codering_naam(codering));
+	}
+
+	if (comprimeren)
+		rep.set_header("Vary", "Accept-Encoding");
 
 	return result;
 }
 
-std::vector<float> waarden_op_deze_dag(StandMap &sm, std::chrono::system_clock::time_point t, aggregatie_type aggr)
+// --------------------------------------------------------------------
+
+// The period over which the use is averaged for each aggregation type
+std::chrono::system_clock::duration aggregatie_periode(aggregatie_type aggr)
 {
-	using namespace date;
-	// using namespace std::chrono;
-	using namespace std::literals;
+	switch (aggr)
+	{
+		case aggregatie_type::dag: return date::days{ 1 };
+		case aggregatie_type::week: return date::weeks{ 1 };
+		case aggregatie_type::maand: return date::months{ 1 };
+		case aggregatie_type::jaar: return date::years{ 1 };
+	}
 
-	auto smb = sm.begin()->first;
+	return date::days{ 1 };
+}
 
-	std::vector<float> v;
+zeep::http::reply e_rest_controller::get_grafiek(grafiek_type type, aggregatie_type aggr, std::optional<std::string> formaat)
+{
+	auto data = DataService::instance().get_grafiek(type, aggr);
+
+	auto rep = zeep::http::reply::stock_reply(zeep::http::ok);
 
-	while (t >= smb)
+	if (is_kolommen(formaat))
+	{
+		// one point per day, starting at the first of January
+		KolomSchrijver schrijver(data->empty() ? "" : data->front().date, date::days{ 1 }, data->size());
+		schrijver.kolom("v", 3, [&data](size_t i) { return (*data)[i].v; });
+		schrijver.kolom("a", 3, [&data](size_t i) { return (*data)[i].a; });
+		schrijver.kolom("sd", 3, [&data](size_t i) { return (*data)[i].sd; });
+		schrijver.kolom("ma", 3, [&data](size_t i) { return (*data)[i].ma; });
+
+		rep.set_content(std::move(schrijver).str(), "application/json");
+	}
+	else
 	{
-		v.push_back(interpoleerVerbruik(sm, t, aggr));
-		t -= years{ 1 };
+		zeep::json::element e;
+		to_element(e, *data);
+		rep.set_content(e);
 	}
 
-	return v;
+	return rep;
 }
 
-std::vector<DataPunt> e_rest_controller::get_grafiek(grafiek_type type, aggregatie_type aggr)
+std::vector<DataPunt> bereken_grafiek(const StandMap &sm, aggregatie_type aggr, date::sys_days nu)
 {
 	using namespace date;
 	// using namespace std::chrono;
 	using namespace std::literals;
 
-	StandMap sm = DataService::instance().get_stand_map(type);
-
 	if (sm.empty())
 		return {};
 
-	auto nu = floor<std::chrono::days>(std::chrono::system_clock::now());
 	auto jaar = year_month_day{ floor<days>(nu) }.year();
 
 	auto b = sys_days{ year{ jaar } / January / 1 } + 0h;
 	auto e = sys_days{ year{ jaar } / December / 31 } + 0h;
 
-	std::vector<DataPunt> result;
+	auto periode = aggregatie_periode(aggr);
+
+	// First collect the use for this day in each year of history and the
+	// moving average for all days, then interpolate them in one sweep.
+
+	struct DagVragen
+	{
+		size_t eerste, aantal, ma;
+	};
+
+	VerbruikBerekening berekening(sm);
+	std::vector<DagVragen> vragen;
 
 	for (auto d = b; d <= e; d += 24h)
 	{
-		auto v = waarden_op_deze_dag(sm, d + days{ 1 }, aggr);
+		DagVragen v{ berekening.size(), 0, 0 };
+
+		for (std::chrono::system_clock::time_point t = d + days{ 1 }; t >= sm.eerste_tijd(); t -= years{ 1 })
+		{
+			berekening.vraag(t, periode);
+			++v.aantal;
+		}
+
+		if (d > nu - days{ 1 })
+			v.ma = berekening.vraag(d - years{ 1 }, years{ 1 });
+		else
+			v.ma = berekening.vraag(d, years{ 1 });
+
+		vragen.push_back(v);
+	}
 
-		auto N = v.size();
+	auto verbruik = berekening.bereken();
+
+	std::vector<DataPunt> result;
+
+	auto d = b;
+	for (auto &dv : vragen)
+	{
+		auto v = verbruik.begin() + dv.eerste;
+		auto N = dv.aantal;
 
 		DataPunt pt{};
 
 		pt.date = date::format("%F", d);
 
 		if (d > nu + days{ 1 })
-			pt.v = v[1];
-		else if (d <= nu)
-			pt.v = v.front();
+		{
+			if (N > 1)
+				pt.v = v[1];
+		}
+		else if (d <= nu and N > 0)
+			pt.v = v[0];
 
-		if (d > nu - days{ 1 })
-			pt.ma = interpoleerVerbruik(sm, d - years{ 1 }, aggregatie_type::jaar);
-		else
-			pt.ma = interpoleerVerbruik(sm, d, aggregatie_type::jaar);
+		pt.ma = verbruik[dv.ma];
 
 		if (N > 1)
 		{
@@ -685,6 +1594,7 @@ std::vector<DataPunt> e_rest_controller::get_grafiek(grafiek_type type, aggregat
 		}
 
 		result.emplace_back(std::move(pt));
+		d += 24h;
 	}
 
 	return result;
@@ -710,13 +1620,157 @@ class e_web_controller : public zeep::http::html_controller
 	zeep::http::reply opname(const zeep::http::scope &scope);
 	void invoer(const zeep::http::request &request, const zeep::http::scope &scope, zeep::http::reply &reply);
 	void grafiek(const zeep::http::request &request, const zeep::http::scope &scope, zeep::http::reply &reply);
+
+	void handle_file(const zeep::http::request &request, const zeep::http::scope &scope, zeep::http::reply &reply);
+
+	bool handle_request(zeep::http::request &req, zeep::http::reply &rep) override;
+
+  private:
+	// The contents of manifest.json, written by webpack. It maps the plain
+	// names of scripts, style sheets and fonts to names containing a hash
+	// of their content, per directory.
+	const zeep::json::element &get_assets();
+
+	std::once_flag m_assets_geladen;
+	zeep::json::element m_assets;
+	std::map<std::string, std::string> m_asset_namen;
+	std::set<std::string> m_gehashte_assets;
 };
 
+const zeep::json::element &e_web_controller::get_assets()
+{
+	std::call_once(m_assets_geladen, [this]()
+		{
+		try
+		{
+			std::unique_ptr<std::istream> in;
+			get_template_processor().load_template("manifest.json", in);
+
+			if (in)
+				zeep::json::parse_json(*in, m_assets);
+		}
+		catch (const std::exception &ex)
+		{
+			std::clog << "Could not load manifest.json: " << ex.what() << '\n';
+		}
+
+		for (auto &[dir, bestanden] : m_assets.items())
+		{
+			for (auto &[naam, gehasht] : bestanden.items())
+			{
+				m_asset_namen[dir + '/' + naam] = dir + '/' + gehasht.as<std::string>();
+				m_gehashte_assets.insert(dir + '/' + gehasht.as<std::string>());
+			}
+		} });
+
+	return m_assets;
+}
+
+// Static files are served directly, the pages query the database and
+// are rendered on the bounded executor.
+
+bool e_web_controller::handle_request(zeep::http::request &req, zeep::http::reply &rep)
+{
+	auto path = get_prefixless_path(req);
+
+	if (path.starts_with("css/") or path.starts_with("scripts/") or path.starts_with("fonts/"))
+		return zeep::http::html_controller::handle_request(req, rep);
+
+	try
+	{
+		return Uitvoerder::instance().voer_uit([this, &req, &rep]()
+			{ return zeep::http::html_controller::handle_request(req, rep); });
+	}
+	catch (const Verzadigd &)
+	{
+		return antwoord_bezet(rep);
+	}
+}
+
+// Files with a content hash in their name never change, browsers may
+// keep them forever. Scripts and style sheets have a brotli and gzip
+// compressed copy next to them, which is sent as is when accepted.
+// A plain name is still served, but may not be cached.
+
+void e_web_controller::handle_file(const zeep::http::request &request, const zeep::http::scope &scope, zeep::http::reply &reply)
+{
+	get_assets();
+
+	auto file = get_prefixless_path(request);
+
+	bool gehasht = m_gehashte_assets.contains(file);
+	if (not gehasht)
+	{
+		auto i = m_asset_namen.find(file);
+		if (i == m_asset_namen.end())
+		{
+			zeep::http::html_controller::handle_file(request, scope, reply);
+			return;
+		}
+
+		file = i->second;
+	}
+
+	std::string content_type = "application/octet-stream";
+	if (file.ends_with(".js"))
+		content_type = "text/javascript";
+	else if (file.ends_with(".css"))
+		content_type = "text/css";
+	else if (file.ends_with(".woff2"))
+		content_type = "font/woff2";
+	else if (file.ends_with(".woff"))
+		content_type = "font/woff";
+
+	auto &tp = get_template_processor();
+	auto accept_encoding = request.get_header("Accept-Encoding");
+
+	std::unique_ptr<std::istream> in;
+	const char *codering = nullptr;
+
+	for (auto [naam, ext] : { std::pair{ "br", ".br" }, std::pair{ "gzip", ".gz" } })
+	{
+		if (q_waarde(accept_encoding, naam) <= 0)
+			continue;
+
+		std::error_code ec;
+		tp.file_time(file + ext, ec);
+		if (ec)
+			continue;
+
+		tp.load_template(file + ext, in);
+		if (in)
+		{
+			codering = naam;
+			break;
+		}
+	}
+
+	if (not in)
+		tp.load_template(file, in);
+
+	if (not in)
+	{
+		reply = zeep::http::reply::stock_reply(zeep::http::not_found);
+		return;
+	}
+
+	reply = zeep::http::reply::stock_reply(zeep::http::ok);
+	reply.set_content(in.release(), content_type);
+
+	if (codering)
+		reply.set_header("Content-Encoding", codering);
+	if (content_type.starts_with("text/"))
+		reply.set_header("Vary", "Accept-Encoding");
+
+	reply.set_header("Cache-Control", gehasht ? "public, max-age=31536000, immutable" : "no-cache");
+}
+
 zeep::http::reply e_web_controller::status(const zeep::http::scope &scope)
 {
 	zeep::http::scope sub(scope);
 
 	sub.put("page", "status");
+	sub.put("assets", get_assets());
 
 	zeep::json::element soc;
 	auto socv = SessyService::instance().get_soc();
@@ -736,16 +1790,16 @@ zeep::http::reply e_web_controller::opname(const zeep::http::scope &scope)
 	zeep::http::scope sub(scope);
 
 	sub.put("page", "opname");
+	sub.put("assets", get_assets());
 
-	auto v = DataService::instance().get_all_opnames();
+	// only the first page, the rest is loaded by the script
+	auto v = DataService::instance().get_opnames({}, 0, kOpnamesPerPagina);
 	zeep::json::element opnames;
 	to_element(opnames, v);
 	sub.put("opnames", opnames);
+	sub.put("meer", v.size() == kOpnamesPerPagina);
 
-	auto u = DataService::instance().get_tellers();
-	zeep::json::element tellers;
-	to_element(tellers, u);
-	sub.put("tellers", tellers);
+	sub.put("tellers", DataService::instance().get_teller_gegevens()->json);
 
 	// huidige stand, if any
 
@@ -755,12 +1809,13 @@ zeep::http::reply e_web_controller::opname(const zeep::http::scope &scope)
 		huidig.id.clear();
 		huidig.datum = {};
 
-		auto p1_w = P1Service::instance().get_current();
-
-		huidig.standen["2"] = p1_w.verbruik_laag;
-		huidig.standen["3"] = p1_w.verbruik_hoog;
-		huidig.standen["4"] = p1_w.levering_laag;
-		huidig.standen["5"] = p1_w.levering_hoog;
+		if (auto p1_w = P1Service::instance().get_current())
+		{
+			huidig.standen.set(2, p1_w->verbruik_laag);
+			huidig.standen.set(3, p1_w->verbruik_hoog);
+			huidig.standen.set(4, p1_w->levering_laag);
+			huidig.standen.set(5, p1_w->levering_hoog);
+		}
 
 		zeep::json::element opname;
 		to_element(opname, huidig);
@@ -778,6 +1833,7 @@ void e_web_controller::invoer(const zeep::http::request &request, const zeep::ht
 	zeep::http::scope sub(scope);
 
 	sub.put("page", "invoer");
+	sub.put("assets", get_assets());
 
 	Opname o;
 
@@ -790,12 +1846,13 @@ void e_web_controller::invoer(const zeep::http::request &request, const zeep::ht
 			o.id.clear();
 			o.datum = {};
 
-			auto p1_w = P1Service::instance().get_current();
-
-			o.standen["2"] = p1_w.verbruik_laag;
-			o.standen["3"] = p1_w.verbruik_hoog;
-			o.standen["4"] = p1_w.levering_laag;
-			o.standen["5"] = p1_w.levering_hoog;
+			if (auto p1_w = P1Service::instance().get_current())
+			{
+				o.standen.set(2, p1_w->verbruik_laag);
+				o.standen.set(3, p1_w->verbruik_hoog);
+				o.standen.set(4, p1_w->levering_laag);
+				o.standen.set(5, p1_w->levering_hoog);
+			}
 		}
 		catch (const std::exception &e)
 		{
@@ -808,10 +1865,7 @@ void e_web_controller::invoer(const zeep::http::request &request, const zeep::ht
 	to_element(opname, o);
 	sub.put("opname", opname);
 
-	auto u = DataService::instance().get_tellers();
-	zeep::json::element tellers;
-	to_element(tellers, u);
-	sub.put("tellers", tellers);
+	sub.put("tellers", DataService::instance().get_teller_gegevens()->json);
 
 	get_template_processor().create_reply_from_template("invoer.html", sub, reply);
 }
@@ -821,22 +1875,127 @@ void e_web_controller::grafiek(const zeep::http::request &request, const zeep::h
 	zeep::http::scope sub(scope);
 
 	sub.put("page", "grafiek");
+	sub.put("assets", get_assets());
 
-	auto v = DataService::instance().get_all_opnames();
-	zeep::json::element opnames;
-	to_element(opnames, v);
-	sub.put("opnames", opnames);
-
-	auto u = DataService::instance().get_tellers();
-	zeep::json::element tellers;
-	to_element(tellers, u);
-	sub.put("tellers", tellers);
+	sub.put("tellers", DataService::instance().get_teller_gegevens()->json);
 
 	get_template_processor().create_reply_from_template("grafiek.html", sub, reply);
 }
 
 // --------------------------------------------------------------------
 
+// Exports the metrics in the Prometheus text format on /metrics
+
+class e_metrics_controller : public zeep::http::controller
+{
+  public:
+	e_metrics_controller()
+		: zeep::http::controller("metrics")
+	{
+	}
+
+	bool handle_request(zeep::http::request &req, zeep::http::reply &rep) override
+	{
+		if (not get_prefixless_path(req).empty())
+			return false;
+
+		std::ostringstream os;
+		Metrieken::instance().schrijf(os);
+
+		rep = zeep::http::reply::stock_reply(zeep::http::ok);
+		rep.set_content(os.str(), "text/plain; version=0.0.4");
+		rep.set_header("Cache-Control", "no-store");
+
+		return true;
+	}
+};
+
+// Administrative pages, admin/trace returns the spans recorded by the
+// trace option as Chrome trace event JSON
+
+class e_admin_controller : public zeep::http::controller
+{
+  public:
+	e_admin_controller()
+		: zeep::http::controller("admin")
+	{
+	}
+
+	bool handle_request(zeep::http::request &req, zeep::http::reply &rep) override
+	{
+		if (get_prefixless_path(req) != "trace")
+			return false;
+
+		if (not Trace::actief())
+		{
+			rep = zeep::http::reply::stock_reply(zeep::http::not_found);
+			return true;
+		}
+
+		std::ostringstream os;
+		Trace::instance().dump(os);
+
+		rep = zeep::http::reply::stock_reply(zeep::http::ok);
+		rep.set_content(os.str(), "application/json");
+		rep.set_header("Content-Disposition", "attachment; filename=\"energyd-trace.json\"");
+		rep.set_header("Cache-Control", "no-store");
+
+		return true;
+	}
+};
+
+// health reports the state of each subsystem and always returns 200 as
+// long as the server is running, ready returns 503 until all subsystems
+// are up.
+
+class e_gezondheid_controller : public zeep::http::controller
+{
+  public:
+	e_gezondheid_controller(const std::string &prefix, bool alleen_gereed)
+		: zeep::http::controller(prefix)
+		, m_alleen_gereed(alleen_gereed)
+	{
+	}
+
+	bool handle_request(zeep::http::request &req, zeep::http::reply &rep) override
+	{
+		if (not get_prefixless_path(req).empty())
+			return false;
+
+		auto &gezondheid = Gezondheid::instance();
+
+		bool gereed = true;
+
+		zeep::json::element subsystemen;
+		for (auto &[naam, status] : gezondheid.get_status())
+		{
+			auto &subsysteem = subsystemen[naam];
+			subsysteem["status"] = toestand_naam(status.toestand);
+			subsysteem["sinds"] = zeep::value_serializer<std::chrono::system_clock::time_point>::to_string(status.sinds);
+			if (not status.bericht.empty())
+				subsysteem["bericht"] = status.bericht;
+
+			if (status.toestand != Toestand::gereed)
+				gereed = false;
+		}
+
+		zeep::json::element result;
+		result["status"] = gereed ? "gereed" : "niet gereed";
+		result["subsystemen"] = std::move(subsystemen);
+
+		rep = zeep::http::reply::stock_reply(m_alleen_gereed and not gereed ? zeep::http::service_unavailable : zeep::http::ok);
+		rep.set_content(result);
+		rep.set_header("Cache-Control", "no-store");
+
+		return true;
+	}
+
+  private:
+	bool m_alleen_gereed;
+};
+
+// --------------------------------------------------------------------
+
 class e_error_handler : public zeep::http::error_handler
 {
   public:
@@ -848,8 +2007,8 @@ class e_error_handler : public zeep::http::error_handler
 		}
 		catch (pqxx::broken_connection &ex)
 		{
+			// the connection pool drops the broken connection
 			std::cerr << ex.what() << std::endl;
-			DataService::instance().reset();
 		}
 		catch (...)
 		{
@@ -859,6 +2018,21 @@ class e_error_handler : public zeep::http::error_handler
 	}
 };
 
+// --------------------------------------------------------------------
+// Stops the collecting threads before a reload or on exit. The collector
+// goes first, it stores the interval in progress using the P1 and Sessy
+// data and then waits for the writer to drain. Only then are the
+// devices closed. The listener of DataService uses the connection pool,
+// it is stopped before the pool is initialised again or destroyed.
+
+void stop_diensten()
+{
+	DataService_v2::stop();
+	SessyService::stop();
+	P1Service::stop();
+	DataService::stop();
+}
+
 // --------------------------------------------------------------------
 
 int main(int argc, const char *argv[])
@@ -882,9 +2056,21 @@ int main(int argc, const char *argv[])
 		mcfp::make_option<std::string>("web-user-password", "User password"),
 		mcfp::make_option<std::string>("web-secret", "Secret hash for web tokens"),
 		mcfp::make_option<std::string>("databank", "The Postgresql connection string"),
+		mcfp::make_option<size_t>("db-pool-size", 4, "Maximum number of connections to the database"),
+		mcfp::make_option<size_t>("grafiek-cache", 128, "Maximum number of status graph days kept in memory"),
+		mcfp::make_option<size_t>("compressie-drempel", 1024, "Compress ajax replies of at least this many bytes, 0 to disable"),
+
+		mcfp::make_option<int>("sample-interval", 120, "Interval in seconds between two samples for the status graph"),
+		mcfp::make_option<size_t>("grafiek-dagen", 7, "Number of days of status graph data kept in memory, 0 to disable"),
+		mcfp::make_option<size_t>("store-batch", "Number of samples written to the database at once, default is one write per two minutes"),
+		mcfp::make_option<size_t>("schrijf-wachtrij", 4096, "Maximum number of samples waiting to be written"),
+		mcfp::make_option<std::string>("schrijf-beleid", "verwerp", "What to do when the write queue is full, verwerp (drop the sample) or wacht (block the collector up to a second)"),
+		mcfp::make_option<std::string>("opslag", "postgresql", "Storage for the status graph samples, either postgresql or bestand"),
+		mcfp::make_option<std::string>("opslag-map", "/var/lib/energyd", "Directory containing the segment files when opslag is bestand"),
 
 		mcfp::make_option<std::string>("p1-device", "/dev/ttyUSB0", "The name of the device used to communicate with the P1 port"),
 
+		mcfp::make_option<int>("sessy-poll-interval", 10, "Interval in seconds between two polls of the sessy batteries"),
 		mcfp::make_option<std::string>("sessy-1", "URL to fetch the status of sessy number 1"),
 		mcfp::make_option<std::string>("sessy-2", "URL to fetch the status of sessy number 2"),
 		mcfp::make_option<std::string>("sessy-3", "URL to fetch the status of sessy number 3"),
@@ -892,7 +2078,14 @@ int main(int argc, const char *argv[])
 		mcfp::make_option<std::string>("sessy-5", "URL to fetch the status of sessy number 5"),
 		mcfp::make_option<std::string>("sessy-6", "URL to fetch the status of sessy number 6"),
 
-		mcfp::make_option("read-only", "Do not write data into the database (debug option)"));
+		mcfp::make_option("read-only", "Do not write data into the database (debug option)"),
+
+		mcfp::make_option("trace", "Record trace spans of the collector pipeline, available at /admin/trace"),
+		mcfp::make_option<size_t>("trace-buffer", 16384, "Number of trace spans kept in memory"),
+
+		mcfp::make_option<size_t>("threads", 8, "Number of threads handling http requests"),
+		mcfp::make_option<size_t>("db-threads", 4, "Number of threads for requests that query the database"),
+		mcfp::make_option<size_t>("db-wachtrij", 2, "Number of database requests that may wait for a thread, more are refused with 503"));
 
 	std::error_code ec;
 	config.parse(argc, argv, ec);
@@ -930,6 +2123,11 @@ Command should be either:
 		return 1;
 	}
 
+	// At most db-threads + db-wachtrij server threads wait for the executor,
+	// the others must remain to serve static files and metrics.
+	if (config.get<size_t>("db-threads") + config.get<size_t>("db-wachtrij") >= config.get<size_t>("threads"))
+		std::cerr << "Warning: db-threads + db-wachtrij should be less than threads, slow queries may block all requests" << std::endl;
+
 	// --------------------------------------------------------------------
 
 	if (config.operands().front() == "passwd")
@@ -977,9 +2175,16 @@ Command should be either:
 		if (config.has("context"))
 			s->set_context_name(config.get("context"));
 
-		P1Service::init(s->get_io_context());
-		DataService::init(config.get("databank"));
+		// in case of a reload
+		stop_diensten();
+
+		Trace::instance();
+		Uitvoerder::init(config.get<size_t>("db-threads"), config.get<size_t>("db-wachtrij"));
+		P1Service::init();
+		ConnectionPool::init(config.get("databank"), config.get<size_t>("db-pool-size"));
+		DataService::init();
 		DataService_v2::instance();
+		GrafiekCache::instance();
 		SessyService::init(s->get_io_context());
 
 		// zeep::http::daemon server([&config]()
@@ -991,6 +2196,10 @@ Command should be either:
 		s->set_template_processor(new zeep::http::rsrc_based_html_template_processor());
 #endif
 
+		s->add_controller(new e_metrics_controller());
+		s->add_controller(new e_admin_controller());
+		s->add_controller(new e_gezondheid_controller("health", false));
+		s->add_controller(new e_gezondheid_controller("ready", true));
 		s->add_controller(new e_rest_controller());
 		s->add_controller(new e_web_controller());
 		if (sc)
@@ -1017,8 +2226,10 @@ Command should be either:
 		else
 		{
 			std::string user = config.get("user");
-			result = server.start(address, port, 4, user);
+			result = server.start(address, port, config.get<size_t>("threads"), user);
 		}
+
+		stop_diensten();
 	}
 	else if (command == "stop")
 		result = server.stop();
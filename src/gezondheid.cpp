@@ -0,0 +1,83 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "gezondheid.hpp"
+
+#include <algorithm>
+
+// --------------------------------------------------------------------
+
+const char *toestand_naam(Toestand toestand)
+{
+	switch (toestand)
+	{
+		case Toestand::opstarten: return "opstarten";
+		case Toestand::gereed: return "gereed";
+		case Toestand::fout: return "fout";
+	}
+
+	return "onbekend";
+}
+
+// --------------------------------------------------------------------
+
+std::unique_ptr<Gezondheid> Gezondheid::s_instance;
+
+Gezondheid &Gezondheid::instance()
+{
+	static std::once_flag s_once;
+	std::call_once(s_once, []()
+		{ s_instance.reset(new Gezondheid); });
+	return *s_instance;
+}
+
+void Gezondheid::meld(const std::string &subsysteem, Toestand toestand, const std::string &bericht)
+{
+	std::unique_lock lock(m_mutex);
+
+	auto &status = m_status[subsysteem];
+
+	if (status.sinds == std::chrono::system_clock::time_point{} or status.toestand != toestand)
+		status.sinds = std::chrono::system_clock::now();
+
+	status.toestand = toestand;
+	status.bericht = bericht;
+}
+
+bool Gezondheid::gereed() const
+{
+	std::unique_lock lock(m_mutex);
+
+	return std::all_of(m_status.begin(), m_status.end(), [](auto &s)
+		{ return s.second.toestand == Toestand::gereed; });
+}
+
+std::map<std::string, Gezondheid::Status> Gezondheid::get_status() const
+{
+	std::unique_lock lock(m_mutex);
+	return m_status;
+}
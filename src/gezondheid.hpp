@@ -0,0 +1,79 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// --------------------------------------------------------------------
+// The state of the subsystems, as reported by the subsystems themselves.
+// Subsystems connect to their devices and the database on their own
+// thread, the server does not wait for them. /ready tells whether all
+// subsystems that reported are up.
+
+enum class Toestand
+{
+	opstarten,
+	gereed,
+	fout
+};
+
+const char *toestand_naam(Toestand toestand);
+
+class Gezondheid
+{
+  public:
+	struct Status
+	{
+		Toestand toestand;
+		std::string bericht;
+		std::chrono::system_clock::time_point sinds;
+	};
+
+	static Gezondheid &instance();
+
+	// Report the state of a subsystem, sinds is only updated when the
+	// state changes
+	void meld(const std::string &subsysteem, Toestand toestand, const std::string &bericht = {});
+
+	// True when all subsystems are gereed
+	bool gereed() const;
+
+	std::map<std::string, Status> get_status() const;
+
+  private:
+	Gezondheid() = default;
+
+	mutable std::mutex m_mutex;
+	std::map<std::string, Status> m_status;
+
+	static std::unique_ptr<Gezondheid> s_instance;
+};
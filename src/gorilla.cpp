@@ -0,0 +1,264 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gorilla.hpp"
+
+#include <bit>
+#include <cstring>
+
+// --------------------------------------------------------------------
+
+GorillaEncoder::GorillaEncoder(size_t kolommen)
+	: m_kolommen(kolommen)
+{
+}
+
+void GorillaEncoder::schrijf_bits(uint64_t v, int n)
+{
+	while (n > 0)
+	{
+		if (m_vrij == 0)
+		{
+			m_data.push_back(0);
+			m_vrij = 8;
+		}
+
+		int k = n < m_vrij ? n : m_vrij;
+		uint8_t bits = (v >> (n - k)) & ((1U << k) - 1);
+
+		m_data.back() |= bits << (m_vrij - k);
+		m_vrij -= k;
+		n -= k;
+	}
+}
+
+void GorillaEncoder::add(int64_t tijd, const float *waarden)
+{
+	// timestamp
+
+	if (m_aantal == 0)
+		schrijf_bits(static_cast<uint64_t>(tijd), 64);
+	else
+	{
+		int64_t delta = tijd - m_vorige_tijd;
+		int64_t dod = delta - m_vorige_delta;
+
+		if (dod == 0)
+			schrijf_bits(0b0, 1);
+		else if (dod >= -64 and dod <= 63)
+		{
+			schrijf_bits(0b10, 2);
+			schrijf_bits(static_cast<uint64_t>(dod), 7);
+		}
+		else if (dod >= -256 and dod <= 255)
+		{
+			schrijf_bits(0b110, 3);
+			schrijf_bits(static_cast<uint64_t>(dod), 9);
+		}
+		else if (dod >= -2048 and dod <= 2047)
+		{
+			schrijf_bits(0b1110, 4);
+			schrijf_bits(static_cast<uint64_t>(dod), 12);
+		}
+		else
+		{
+			schrijf_bits(0b1111, 4);
+			schrijf_bits(static_cast<uint64_t>(dod), 64);
+		}
+
+		m_vorige_delta = delta;
+	}
+
+	m_vorige_tijd = tijd;
+
+	// values
+
+	for (size_t i = 0; i < m_kolommen.size(); ++i)
+	{
+		auto &k = m_kolommen[i];
+
+		uint32_t v;
+		std::memcpy(&v, waarden + i, sizeof(v));
+
+		if (m_aantal == 0)
+			schrijf_bits(v, 32);
+		else
+		{
+			uint32_t x = v ^ k.vorige;
+
+			if (x == 0)
+				schrijf_bits(0b0, 1);
+			else
+			{
+				int leading = std::countl_zero(x);
+				int trailing = std::countr_zero(x);
+
+				if (leading > 31)
+					leading = 31;
+
+				if (k.leading >= 0 and leading >= k.leading and trailing >= k.trailing)
+				{
+					// fits in the previous window
+					schrijf_bits(0b10, 2);
+					schrijf_bits(x >> k.trailing, 32 - k.leading - k.trailing);
+				}
+				else
+				{
+					int lengte = 32 - leading - trailing;
+
+					schrijf_bits(0b11, 2);
+					schrijf_bits(leading, 5);
+					schrijf_bits(lengte - 1, 5);
+					schrijf_bits(x >> trailing, lengte);
+
+					k.leading = leading;
+					k.trailing = trailing;
+				}
+			}
+		}
+
+		k.vorige = v;
+	}
+
+	++m_aantal;
+}
+
+// --------------------------------------------------------------------
+
+GorillaDecoder::GorillaDecoder(const uint8_t *data, size_t length, size_t kolommen, size_t aantal)
+	: m_data(data)
+	, m_length(length)
+	, m_aantal(aantal)
+	, m_kolommen(kolommen)
+{
+}
+
+uint64_t GorillaDecoder::lees_bits(int n)
+{
+	uint64_t result = 0;
+
+	if (m_bit + n > m_length * 8)
+	{
+		m_fout = true;
+		return 0;
+	}
+
+	while (n > 0)
+	{
+		size_t byte = m_bit / 8;
+		int offset = m_bit % 8;
+		int k = 8 - offset;
+		if (k > n)
+			k = n;
+
+		uint8_t bits = (m_data[byte] >> (8 - offset - k)) & ((1U << k) - 1);
+
+		result = (result << k) | bits;
+		m_bit += k;
+		n -= k;
+	}
+
+	return result;
+}
+
+// sign extend the lowest n bits of v
+static int64_t sign_extend(uint64_t v, int n)
+{
+	if (n < 64 and (v & (uint64_t{ 1 } << (n - 1))))
+		v |= ~uint64_t{ 0 } << n;
+	return static_cast<int64_t>(v);
+}
+
+bool GorillaDecoder::next(int64_t &tijd, float *waarden)
+{
+	if (m_gelezen >= m_aantal or m_fout)
+		return false;
+
+	// timestamp
+
+	if (m_gelezen == 0)
+		tijd = static_cast<int64_t>(lees_bits(64));
+	else
+	{
+		int64_t dod;
+
+		if (lees_bits(1) == 0)
+			dod = 0;
+		else if (lees_bits(1) == 0)
+			dod = sign_extend(lees_bits(7), 7);
+		else if (lees_bits(1) == 0)
+			dod = sign_extend(lees_bits(9), 9);
+		else if (lees_bits(1) == 0)
+			dod = sign_extend(lees_bits(12), 12);
+		else
+			dod = static_cast<int64_t>(lees_bits(64));
+
+		m_vorige_delta += dod;
+		tijd = m_vorige_tijd + m_vorige_delta;
+	}
+
+	m_vorige_tijd = tijd;
+
+	// values
+
+	for (size_t i = 0; i < m_kolommen.size(); ++i)
+	{
+		auto &k = m_kolommen[i];
+
+		uint32_t v;
+
+		if (m_gelezen == 0)
+			v = static_cast<uint32_t>(lees_bits(32));
+		else if (lees_bits(1) == 0)
+			v = k.vorige;
+		else
+		{
+			if (lees_bits(1) == 1)
+			{
+				k.leading = static_cast<int>(lees_bits(5));
+				int lengte = static_cast<int>(lees_bits(5)) + 1;
+				k.trailing = 32 - k.leading - lengte;
+			}
+
+			int lengte = 32 - k.leading - k.trailing;
+			if (lengte <= 0 or lengte > 32)
+			{
+				m_fout = true;
+				return false;
+			}
+
+			uint32_t x = static_cast<uint32_t>(lees_bits(lengte) << k.trailing);
+			v = k.vorige ^ x;
+		}
+
+		std::memcpy(waarden + i, &v, sizeof(v));
+		k.vorige = v;
+	}
+
+	++m_gelezen;
+
+	return not m_fout;
+}
@@ -0,0 +1,99 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------------------
+// Compression of time series as described in "Gorilla: A Fast, Scalable,
+// In-Memory Time Series Database" (Pelkonen et al., 2015). Timestamps
+// are stored as delta-of-delta, each float column as the XOR with its
+// previous value. A block holds a fixed number of float columns per
+// timestamp, values are encoded row by row.
+
+class GorillaEncoder
+{
+  public:
+	GorillaEncoder(size_t kolommen);
+
+	void add(int64_t tijd, const float *waarden);
+
+	size_t size() const
+	{
+		return m_aantal;
+	}
+
+	// The encoded bits, the last byte is padded with zeros
+	const std::vector<uint8_t> &data() const
+	{
+		return m_data;
+	}
+
+  private:
+	void schrijf_bits(uint64_t v, int n);
+
+	struct Kolom
+	{
+		uint32_t vorige = 0;
+		int leading = -1, trailing = 0;
+	};
+
+	std::vector<uint8_t> m_data;
+	int m_vrij = 0;
+
+	size_t m_aantal = 0;
+	int64_t m_vorige_tijd = 0, m_vorige_delta = 0;
+	std::vector<Kolom> m_kolommen;
+};
+
+class GorillaDecoder
+{
+  public:
+	GorillaDecoder(const uint8_t *data, size_t length, size_t kolommen, size_t aantal);
+
+	// Returns false when all values have been read, or the data is corrupt
+	bool next(int64_t &tijd, float *waarden);
+
+  private:
+	uint64_t lees_bits(int n);
+
+	struct Kolom
+	{
+		uint32_t vorige = 0;
+		int leading = 0, trailing = 0;
+	};
+
+	const uint8_t *m_data;
+	size_t m_length, m_bit = 0;
+	bool m_fout = false;
+
+	size_t m_aantal, m_gelezen = 0;
+	int64_t m_vorige_tijd = 0, m_vorige_delta = 0;
+	std::vector<Kolom> m_kolommen;
+};
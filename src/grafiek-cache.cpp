@@ -0,0 +1,176 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grafiek-cache.hpp"
+#include "kolommen.hpp"
+
+#include <date/tz.h>
+
+#include <mcfp/mcfp.hpp>
+
+#include <zeep/json/element.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+// --------------------------------------------------------------------
+
+std::unique_ptr<GrafiekCache> GrafiekCache::s_instance;
+
+GrafiekCache &GrafiekCache::instance()
+{
+	if (not s_instance)
+		s_instance.reset(new GrafiekCache);
+	return *s_instance;
+}
+
+GrafiekCache::GrafiekCache()
+{
+	auto &config = mcfp::config::instance();
+
+	// The current day is good for one sample interval
+	m_ttl = std::chrono::seconds{ std::max(config.get<int>("sample-interval"), 1) };
+
+	m_max_size = config.get<size_t>("grafiek-cache");
+	if (m_max_size == 0)
+		m_max_size = 1;
+}
+
+std::shared_ptr<const GrafiekCacheItem> GrafiekCache::get(date::year_month_day dag, std::chrono::minutes resolutie, bool kolommen)
+{
+	using namespace date;
+
+	auto now = std::chrono::system_clock::now();
+	key_type key{ sys_days{ dag }, resolutie.count(), kolommen };
+	uint32_t generatie;
+
+	{
+		std::unique_lock lock(m_mutex);
+
+		generatie = m_generatie;
+
+		if (auto i = m_cache.find(key); i != m_cache.end())
+		{
+			if (i->second.item->verloopt > now)
+			{
+				m_lru.splice(m_lru.begin(), m_lru, i->second.lru);
+				return i->second.item;
+			}
+
+			m_lru.erase(i->second.lru);
+			m_cache.erase(i);
+		}
+	}
+
+	// Not cached, or expired. Compute it without holding the lock
+
+	auto &service = DataService_v2::instance();
+	auto data = service.grafiekVoorDag(dag, resolutie);
+
+	auto begin = make_zoned(current_zone(), local_days{ dag }).get_sys_time();
+	auto einde = make_zoned(current_zone(), local_days{ dag } + days{ 1 }).get_sys_time();
+
+	auto item = std::make_shared<GrafiekCacheItem>();
+
+	if (kolommen)
+		item->json = grafiek_kolommen(data, begin, std::max<std::chrono::seconds>(resolutie, service.get_interval()));
+	else
+	{
+		zeep::json::element e;
+		to_element(e, data);
+
+		std::ostringstream os;
+		os << e;
+		item->json = os.str();
+	}
+
+	item->etag = make_etag(item->json);
+
+	// A day is immutable once it is over, allow for a last sample
+	// to arrive just after midnight.
+	if (einde + m_ttl <= now)
+		item->verloopt = std::chrono::system_clock::time_point::max();
+	else
+		item->verloopt = now + m_ttl;
+
+	std::unique_lock lock(m_mutex);
+
+	// The data may have changed while it was computed
+	if (generatie != m_generatie)
+		return item;
+
+	if (auto i = m_cache.find(key); i != m_cache.end())
+	{
+		m_lru.erase(i->second.lru);
+		m_cache.erase(i);
+	}
+
+	m_lru.push_front(key);
+	m_cache.emplace(key, entry{ item, m_lru.begin() });
+
+	while (m_cache.size() > m_max_size)
+	{
+		m_cache.erase(m_lru.back());
+		m_lru.pop_back();
+	}
+
+	return item;
+}
+
+void GrafiekCache::invalidate(date::year_month_day dag)
+{
+	std::unique_lock lock(m_mutex);
+
+	++m_generatie;
+
+	date::sys_days d{ dag };
+
+	auto i = m_cache.lower_bound({ d, std::numeric_limits<std::chrono::minutes::rep>::min(), false });
+	while (i != m_cache.end() and std::get<0>(i->first) == d)
+	{
+		m_lru.erase(i->second.lru);
+		i = m_cache.erase(i);
+	}
+}
+
+// --------------------------------------------------------------------
+
+std::string make_etag(const std::string &content)
+{
+	// FNV-1a, good enough to tell two payloads apart
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (unsigned char ch : content)
+	{
+		h ^= ch;
+		h *= 0x100000001b3ULL;
+	}
+
+	std::ostringstream os;
+	os << '"' << std::hex << std::setw(16) << std::setfill('0') << h << '"';
+	return os.str();
+}
@@ -0,0 +1,88 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "data-service.hpp"
+
+#include <date/date.h>
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// --------------------------------------------------------------------
+// A bounded LRU cache for the serialized status graph of a single day.
+// Days that are over will never change, they are kept until they are
+// pushed out by more recent requests. The current day expires quickly
+// and is also dropped as soon as a new sample for that day is stored.
+
+struct GrafiekCacheItem
+{
+	std::string json;
+	std::string etag;
+	std::chrono::system_clock::time_point verloopt;
+};
+
+class GrafiekCache
+{
+  public:
+	static GrafiekCache &instance();
+
+	// With kolommen the day is serialized in the columnar format of kolommen.hpp
+	std::shared_ptr<const GrafiekCacheItem> get(date::year_month_day dag, std::chrono::minutes resolutie, bool kolommen = false);
+
+	void invalidate(date::year_month_day dag);
+
+  private:
+	GrafiekCache();
+
+	using key_type = std::tuple<date::sys_days, std::chrono::minutes::rep, bool>;
+	using lru_list = std::list<key_type>;
+
+	struct entry
+	{
+		std::shared_ptr<const GrafiekCacheItem> item;
+		lru_list::iterator lru;
+	};
+
+	std::mutex m_mutex;
+	std::map<key_type, entry> m_cache;
+	lru_list m_lru;
+	size_t m_max_size;
+	std::chrono::seconds m_ttl;
+
+	// bumped by invalidate, a result computed while it changed is not cached
+	uint32_t m_generatie = 0;
+
+	static std::unique_ptr<GrafiekCache> s_instance;
+};
+
+std::string make_etag(const std::string &content);
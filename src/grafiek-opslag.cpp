@@ -0,0 +1,289 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grafiek-opslag.hpp"
+#include "metrics.hpp"
+
+#include <date/tz.h>
+
+#include <mcfp/mcfp.hpp>
+
+#include <iostream>
+#include <sstream>
+
+// --------------------------------------------------------------------
+
+std::unique_ptr<GrafiekOpslag> GrafiekOpslag::create()
+{
+	auto &config = mcfp::config::instance();
+
+	auto opslag = config.get("opslag");
+
+	if (opslag == "postgresql")
+		return std::make_unique<PostgresOpslag>();
+
+	if (opslag == "bestand")
+		return std::make_unique<BestandOpslag>(config.get("opslag-map"));
+
+	throw std::runtime_error("Onbekende opslag: " + opslag);
+}
+
+// --------------------------------------------------------------------
+
+namespace
+{
+
+// Rows written before the extremes and energy were stored have NULL
+// values, those were sampled every two minutes.
+const char kGrafiekKolommen[] = R"(
+	trim(both '\"' from to_json(tijd)::text) AS tijd, soc, batterij, verbruik, levering, opwekking,
+	coalesce(opwekking_min, opwekking), coalesce(opwekking_max, opwekking), coalesce(opwekking_wh, opwekking / 30),
+	coalesce(batterij_min, batterij), coalesce(batterij_max, batterij), coalesce(batterij_wh, batterij / 30),
+	coalesce(verbruik_min, verbruik), coalesce(verbruik_max, verbruik), coalesce(verbruik_wh, verbruik / 30),
+	coalesce(levering_min, levering), coalesce(levering_max, levering), coalesce(levering_wh, levering / 30))";
+
+bool lees_punt(const pqxx::row &r, GrafiekPunt &pt)
+{
+	using namespace date;
+
+	local_time<std::chrono::seconds> t;
+	std::istringstream is(r[0].as<std::string>());
+	is >> parse("%FT%T", t);
+
+	if (is.fail())
+		return false;
+
+	pt = {
+		.tijd = make_zoned(current_zone(), t).get_sys_time(),
+		.zon = r[5].as<float>(),
+		.batterij = r[2].as<float>(),
+		.verbruik = r[3].as<float>(),
+		.levering = r[4].as<float>(),
+		.laad_niveau = r[1].as<float>(),
+
+		.zon_min = r[6].as<float>(),
+		.zon_max = r[7].as<float>(),
+		.zon_wh = r[8].as<float>(),
+		.batterij_min = r[9].as<float>(),
+		.batterij_max = r[10].as<float>(),
+		.batterij_wh = r[11].as<float>(),
+		.verbruik_min = r[12].as<float>(),
+		.verbruik_max = r[13].as<float>(),
+		.verbruik_wh = r[14].as<float>(),
+		.levering_min = r[15].as<float>(),
+		.levering_max = r[16].as<float>(),
+		.levering_wh = r[17].as<float>()
+	};
+
+	return true;
+}
+
+// tijd is stored as local time in the database
+std::string lokale_tijd(std::chrono::system_clock::time_point t)
+{
+	using namespace date;
+	return format("%F %T", floor<std::chrono::seconds>(make_zoned(current_zone(), t).get_local_time()));
+}
+
+std::string query(pqxx::connection &connection, std::chrono::system_clock::time_point van, std::chrono::system_clock::time_point tot)
+{
+	std::string result = std::string{ "SELECT " } + kGrafiekKolommen + "  FROM daily_graph  WHERE tijd >= " + connection.quote(lokale_tijd(van));
+
+	if (tot != std::chrono::system_clock::time_point::max())
+		result += "  AND tijd < " + connection.quote(lokale_tijd(tot));
+
+	return result + "  ORDER BY tijd ASC";
+}
+
+// --------------------------------------------------------------------
+// Reads the rows one block at a time, each block with its own short
+// lease on a connection. A reader may live as long as a slow download,
+// holding a connection all that time would exhaust the pool. Blocks
+// continue from the time of the last row read. Rows sharing that time
+// may be split over two blocks, so a full block drops its last time
+// and the next block starts at it again.
+
+class PostgresLezer : public GrafiekLezer
+{
+  public:
+	PostgresLezer(GrafiekOpslag::time_point van, GrafiekOpslag::time_point tot)
+		: m_vanaf(lokale_tijd(van))
+	{
+		if (tot != GrafiekOpslag::time_point::max())
+			m_tot = lokale_tijd(tot);
+	}
+
+	bool volgende(GrafiekPunt &pt) override
+	{
+		for (;;)
+		{
+			if (m_rij >= m_aantal)
+			{
+				if (m_klaar or not lees_blok())
+					return false;
+			}
+
+			if (lees_punt(m_rows[m_rij++], pt))
+				return true;
+		}
+	}
+
+  private:
+	static constexpr pqxx::result::size_type kBlokGrootte = 1000;
+
+	bool lees_blok()
+	{
+		static auto &s_blok_tijd = db_query_histogram("get-daily-graph-blok");
+		MeetTijd meting(s_blok_tijd);
+
+		auto connection = ConnectionPool::instance().borrow();
+		pqxx::read_transaction tx(*connection);
+
+		std::string sql = std::string{ "SELECT " } + kGrafiekKolommen + "  FROM daily_graph  WHERE tijd " +
+		                  (m_inclusief ? ">= " : "> ") + tx.quote(m_vanaf);
+
+		if (not m_tot.empty())
+			sql += "  AND tijd < " + tx.quote(m_tot);
+
+		sql += "  ORDER BY tijd ASC LIMIT " + std::to_string(kBlokGrootte);
+
+		m_rows = tx.exec(sql);
+		m_rij = 0;
+		m_aantal = m_rows.size();
+
+		if (m_aantal < kBlokGrootte)
+			m_klaar = true;
+		else
+		{
+			// Leave the rows with the last time for the next block,
+			// unless the whole block has the same time
+			auto laatste = m_rows[m_aantal - 1][0].as<std::string>();
+
+			auto n = m_aantal;
+			while (n > 0 and m_rows[n - 1][0].as<std::string>() == laatste)
+				--n;
+
+			m_inclusief = n > 0;
+			if (m_inclusief)
+				m_aantal = n;
+
+			m_vanaf = laatste;
+		}
+
+		return m_aantal > 0;
+	}
+
+	std::string m_vanaf, m_tot;
+	bool m_inclusief = true;
+	bool m_klaar = false;
+	pqxx::result m_rows;
+	pqxx::result::size_type m_rij = 0, m_aantal = 0;
+};
+
+} // namespace
+
+// --------------------------------------------------------------------
+
+void PostgresOpslag::schrijf(const std::vector<GrafiekPunt> &batch)
+{
+	// retry once when the connection was lost
+	for (bool first_try = true;; first_try = false)
+	{
+		try
+		{
+			auto connection = ConnectionPool::instance().borrow();
+			pqxx::transaction tx(*connection);
+
+			std::string sql =
+				"INSERT INTO daily_graph (tijd, soc, batterij, verbruik, levering, opwekking,"
+				" opwekking_min, opwekking_max, opwekking_wh, batterij_min, batterij_max, batterij_wh,"
+				" verbruik_min, verbruik_max, verbruik_wh, levering_min, levering_max, levering_wh) VALUES ";
+
+			bool first = true;
+			for (auto &pt : batch)
+			{
+				if (not first)
+					sql += ", ";
+				first = false;
+
+				sql += "(" +
+					   tx.quote(lokale_tijd(pt.tijd)) + ", " +
+					   tx.quote(pt.laad_niveau) + ", " +
+					   tx.quote(pt.batterij) + ", " +
+					   tx.quote(pt.verbruik) + ", " +
+					   tx.quote(pt.levering) + ", " +
+					   tx.quote(pt.zon) + ", " +
+					   tx.quote(pt.zon_min) + ", " +
+					   tx.quote(pt.zon_max) + ", " +
+					   tx.quote(pt.zon_wh) + ", " +
+					   tx.quote(pt.batterij_min) + ", " +
+					   tx.quote(pt.batterij_max) + ", " +
+					   tx.quote(pt.batterij_wh) + ", " +
+					   tx.quote(pt.verbruik_min) + ", " +
+					   tx.quote(pt.verbruik_max) + ", " +
+					   tx.quote(pt.verbruik_wh) + ", " +
+					   tx.quote(pt.levering_min) + ", " +
+					   tx.quote(pt.levering_max) + ", " +
+					   tx.quote(pt.levering_wh) + ")";
+			}
+
+			static auto &s_insert_tijd = db_query_histogram("insert-daily-graph");
+			MeetTijd meting(s_insert_tijd);
+
+			tx.exec(sql);
+			tx.commit();
+			break;
+		}
+		catch (const pqxx::broken_connection &)
+		{
+			if (first_try)
+				continue;
+
+			throw;
+		}
+	}
+}
+
+void PostgresOpslag::lees(time_point van, time_point tot, std::function<void(const GrafiekPunt &)> &&cb)
+{
+	auto connection = ConnectionPool::instance().borrow();
+	pqxx::transaction tx(*connection);
+
+	static auto &s_lees_tijd = db_query_histogram("get-daily-graph");
+	MeetTijd meting(s_lees_tijd);
+
+	for (auto r : tx.exec(query(*connection, van, tot)))
+	{
+		GrafiekPunt pt;
+		if (lees_punt(r, pt))
+			cb(pt);
+	}
+}
+
+std::unique_ptr<GrafiekLezer> PostgresOpslag::open(time_point van, time_point tot)
+{
+	return std::make_unique<PostgresLezer>(van, tot);
+}
@@ -0,0 +1,107 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "connection-pool.hpp"
+#include "data-service.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------------------
+// Storage for the status graph samples. There is an implementation
+// using PostgreSQL and one using local, append-only segment files.
+
+class GrafiekLezer
+{
+  public:
+	virtual ~GrafiekLezer() = default;
+
+	// Returns false when there are no more points
+	virtual bool volgende(GrafiekPunt &pt) = 0;
+};
+
+class GrafiekOpslag
+{
+  public:
+	using time_point = std::chrono::system_clock::time_point;
+
+	virtual ~GrafiekOpslag() = default;
+
+	// Create the storage as specified by the configuration
+	static std::unique_ptr<GrafiekOpslag> create();
+
+	virtual void schrijf(const std::vector<GrafiekPunt> &batch) = 0;
+
+	// Calls cb for all points with van <= tijd < tot, in chronological order
+	virtual void lees(time_point van, time_point tot, std::function<void(const GrafiekPunt &)> &&cb) = 0;
+
+	// Same, but returns a reader that can be used by another thread
+	// and keeps only a limited number of points in memory
+	virtual std::unique_ptr<GrafiekLezer> open(time_point van, time_point tot) = 0;
+};
+
+// --------------------------------------------------------------------
+
+class PostgresOpslag : public GrafiekOpslag
+{
+  public:
+	void schrijf(const std::vector<GrafiekPunt> &batch) override;
+	void lees(time_point van, time_point tot, std::function<void(const GrafiekPunt &)> &&cb) override;
+	std::unique_ptr<GrafiekLezer> open(time_point van, time_point tot) override;
+};
+
+// --------------------------------------------------------------------
+// Segment files contain blocks of Gorilla compressed samples, one file
+// per (UTC) day. New samples are added to the last block of the day,
+// until it is full and a new block is started. Readers map the files
+// in memory.
+
+class BestandOpslag : public GrafiekOpslag
+{
+  public:
+	BestandOpslag(const std::filesystem::path &map);
+	~BestandOpslag();
+
+	void schrijf(const std::vector<GrafiekPunt> &batch) override;
+	void lees(time_point van, time_point tot, std::function<void(const GrafiekPunt &)> &&cb) override;
+	std::unique_ptr<GrafiekLezer> open(time_point van, time_point tot) override;
+
+  private:
+	struct Staart;
+
+	std::filesystem::path m_map;
+	std::mutex m_mutex;
+
+	// The block samples are currently added to
+	std::unique_ptr<Staart> m_staart;
+};
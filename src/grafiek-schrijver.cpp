@@ -0,0 +1,258 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grafiek-schrijver.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+#include <iostream>
+
+// --------------------------------------------------------------------
+
+namespace
+{
+
+// Maximum time a producer waits for room with SchrijfBeleid::wacht
+constexpr std::chrono::seconds kMaxWacht{ 1 };
+
+// Pause before retrying a batch that failed, doubled after each
+// failure up to the maximum
+constexpr std::chrono::milliseconds kMinPauze{ 500 };
+constexpr std::chrono::seconds kMaxPauze{ 30 };
+
+// Maximum time spent retrying the last samples when stopping
+constexpr std::chrono::seconds kMaxAfvoer{ 5 };
+
+} // namespace
+
+GrafiekSchrijver::GrafiekSchrijver(sink_type &&sink, size_t batch_size, size_t capaciteit, SchrijfBeleid beleid)
+	: m_sink(std::move(sink))
+	, m_batch_size(std::max<size_t>(batch_size, 1))
+	, m_beleid(beleid)
+	, m_wachtrij(std::max(capaciteit, m_batch_size))
+	, m_verworpen_teller(Metrieken::instance().teller("energyd_writer_dropped_total",
+		  "Status graph samples dropped because the write queue was full or could not be written when stopping"))
+	, m_fouten_teller(Metrieken::instance().teller("energyd_writer_failures_total",
+		  "Failed attempts to write a batch of status graph samples, retries included"))
+{
+	registreer_meters(true);
+
+	m_thread = std::jthread([this](std::stop_token stop)
+		{ run(stop); });
+}
+
+GrafiekSchrijver::~GrafiekSchrijver()
+{
+	m_thread.request_stop();
+	if (m_thread.joinable())
+		m_thread.join();
+
+	registreer_meters(false);
+}
+
+// The gauges read this writer, when it is destroyed they are replaced
+// by ones that no longer refer to it
+void GrafiekSchrijver::registreer_meters(bool actief)
+{
+	auto &metrieken = Metrieken::instance();
+
+	auto meter = [&metrieken, actief](const char *naam, const char *help, std::function<double()> waarde)
+	{
+		metrieken.meter(naam, help, actief ? std::move(waarde) : []()
+			{ return 0.0; });
+	};
+
+	meter("energyd_writer_queue_depth", "Status graph samples waiting in the write queue",
+		[this]()
+		{ return static_cast<double>(m_wachtrij.size()); });
+	meter("energyd_writer_queue_capacity", "Maximum number of status graph samples in the write queue",
+		[this]()
+		{ return static_cast<double>(m_wachtrij.capacity()); });
+	meter("energyd_writer_retry_samples", "Status graph samples in a failed batch waiting to be retried",
+		[this]()
+		{ return static_cast<double>(m_opnieuw.load()); });
+}
+
+bool GrafiekSchrijver::push(const GrafiekPunt &pt)
+{
+	bool result = m_wachtrij.push(pt);
+
+	if (not result and m_beleid == SchrijfBeleid::wacht)
+	{
+		std::unique_lock lock(m_ruimte_mutex);
+		m_ruimte_cv.wait_for(lock, kMaxWacht, [this, &pt, &result]()
+			{ return result = m_wachtrij.push(pt); });
+	}
+
+	if (not result)
+	{
+		++m_verworpen;
+		m_verworpen_teller.inc();
+		return false;
+	}
+
+	auto diepte = m_wachtrij.size();
+
+	auto max_diepte = m_max_diepte.load(std::memory_order_relaxed);
+	while (diepte > max_diepte and not m_max_diepte.compare_exchange_weak(max_diepte, diepte, std::memory_order_relaxed))
+		;
+
+	if (diepte >= m_batch_size)
+	{
+		m_signaal.fetch_add(1, std::memory_order_release);
+		m_signaal.notify_one();
+	}
+
+	return true;
+}
+
+SchrijverStatus GrafiekSchrijver::get_status() const
+{
+	return {
+		.diepte = m_wachtrij.size(),
+		.max_diepte = m_max_diepte,
+		.capaciteit = m_wachtrij.capacity(),
+		.geschreven = m_geschreven,
+		.verworpen = m_verworpen,
+		.batches = m_batches,
+		.fouten = m_fouten,
+		.opnieuw = m_opnieuw,
+		.laatste_duur_ms = m_laatste_duur_ms
+	};
+}
+
+void GrafiekSchrijver::run(std::stop_token stop)
+{
+	if (Trace::actief())
+		Trace::instance().thread_naam("schrijver");
+
+	// wake up the writer when a stop is requested
+	std::stop_callback wek(stop, [this]()
+		{
+		m_signaal.fetch_add(1, std::memory_order_release);
+		m_signaal.notify_one(); });
+
+	std::vector<GrafiekPunt> batch;
+	batch.reserve(m_wachtrij.capacity());
+
+	auto pauze = std::chrono::milliseconds{ kMinPauze };
+
+	for (;;)
+	{
+		auto signaal = m_signaal.load(std::memory_order_acquire);
+		bool gestopt = stop.stop_requested();
+
+		if (gestopt)
+			break;
+
+		if (batch.empty())
+		{
+			if (m_wachtrij.size() < m_batch_size)
+			{
+				m_signaal.wait(signaal, std::memory_order_acquire);
+				continue;
+			}
+
+			neem(batch);
+		}
+
+		if (schrijf(batch))
+		{
+			batch.clear();
+			m_opnieuw = 0;
+			pauze = kMinPauze;
+			continue;
+		}
+
+		// Keep the failed batch and stop taking samples from the queue
+		// until it is written. New samples wait in the queue meanwhile,
+		// so when the outage lasts the write policy decides which ones
+		// are dropped.
+		m_opnieuw = batch.size();
+
+		slaap_tot(stop, std::chrono::steady_clock::now() + pauze);
+		pauze = std::min<std::chrono::milliseconds>(pauze * 2, kMaxPauze);
+	}
+
+	// Drain, the last samples are retried for a while so a reload
+	// during a short outage of the storage does not lose them
+	neem(batch);
+
+	auto tot = std::chrono::steady_clock::now() + kMaxAfvoer;
+
+	while (not batch.empty() and not schrijf(batch))
+	{
+		if (std::chrono::steady_clock::now() + kMinPauze >= tot)
+		{
+			std::clog << "Lost " << batch.size() << " status graph samples while stopping\n";
+			m_verworpen += batch.size();
+			m_verworpen_teller.inc(batch.size());
+			break;
+		}
+
+		std::this_thread::sleep_for(kMinPauze);
+	}
+
+	m_opnieuw = 0;
+}
+
+void GrafiekSchrijver::neem(std::vector<GrafiekPunt> &batch)
+{
+	GrafiekPunt pt;
+	while (m_wachtrij.pop(pt))
+		batch.push_back(pt);
+
+	// Taking the lock makes sure a waiting producer either sees the
+	// room or receives the notification
+	{
+		std::unique_lock lock(m_ruimte_mutex);
+	}
+	m_ruimte_cv.notify_all();
+}
+
+bool GrafiekSchrijver::schrijf(const std::vector<GrafiekPunt> &batch)
+{
+	auto start = std::chrono::steady_clock::now();
+	bool result = true;
+
+	try
+	{
+		m_sink(batch);
+		m_geschreven += batch.size();
+	}
+	catch (const std::exception &ex)
+	{
+		++m_fouten;
+		m_fouten_teller.inc();
+		std::clog << "Failed to write status graph samples: " << ex.what() << '\n';
+		result = false;
+	}
+
+	++m_batches;
+	m_laatste_duur_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return result;
+}
@@ -0,0 +1,138 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "data-service.hpp"
+#include "metrics.hpp"
+#include "mpsc-queue.hpp"
+
+#include <zeep/nvp.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------------------
+// Writes status graph samples to storage on its own thread. Producers
+// put samples in a lock-free queue and never wait for the storage,
+// the writer drains the queue in batches. A batch that fails is retried
+// with a growing pause, in the meantime the queue fills up. When
+// destroyed the remaining samples are written, retrying for a limited
+// time when that fails.
+
+struct SchrijverStatus
+{
+	size_t diepte;
+	size_t max_diepte;
+	size_t capaciteit;
+	uint64_t geschreven;
+	uint64_t verworpen;
+	uint64_t batches;
+	uint64_t fouten;
+	size_t opnieuw;
+	float laatste_duur_ms;
+
+	template <typename Archive>
+	void serialize(Archive &ar, unsigned long version)
+	{
+		ar & zeep::make_nvp("diepte", diepte)
+		   & zeep::make_nvp("max_diepte", max_diepte)
+		   & zeep::make_nvp("capaciteit", capaciteit)
+		   & zeep::make_nvp("geschreven", geschreven)
+		   & zeep::make_nvp("verworpen", verworpen)
+		   & zeep::make_nvp("batches", batches)
+		   & zeep::make_nvp("fouten", fouten)
+		   & zeep::make_nvp("opnieuw", opnieuw)
+		   & zeep::make_nvp("laatste_duur_ms", laatste_duur_ms);
+	}
+};
+
+// What to do when the queue is full
+enum class SchrijfBeleid
+{
+	verwerp, // drop the sample immediately
+	wacht    // block the producer a limited time for room, then drop the sample
+};
+
+class GrafiekSchrijver
+{
+  public:
+	using sink_type = std::function<void(const std::vector<GrafiekPunt> &)>;
+
+	GrafiekSchrijver(sink_type &&sink, size_t batch_size, size_t capaciteit, SchrijfBeleid beleid);
+	~GrafiekSchrijver();
+
+	GrafiekSchrijver(const GrafiekSchrijver &) = delete;
+	GrafiekSchrijver &operator=(const GrafiekSchrijver &) = delete;
+
+	// Returns false when the sample was dropped
+	bool push(const GrafiekPunt &pt);
+
+	SchrijverStatus get_status() const;
+
+  private:
+	void run(std::stop_token stop);
+
+	// Moves the samples in the queue to batch
+	void neem(std::vector<GrafiekPunt> &batch);
+
+	// Returns false when the sink failed
+	bool schrijf(const std::vector<GrafiekPunt> &batch);
+
+	void registreer_meters(bool actief);
+
+	sink_type m_sink;
+	size_t m_batch_size;
+	SchrijfBeleid m_beleid;
+
+	MPSCQueue<GrafiekPunt> m_wachtrij;
+
+	// producers waiting for room with SchrijfBeleid::wacht, notified
+	// by the writer after it emptied the queue
+	std::mutex m_ruimte_mutex;
+	std::condition_variable m_ruimte_cv;
+
+	// bumped by producers when a batch is ready, the writer waits on it
+	std::atomic<uint32_t> m_signaal{ 0 };
+
+	std::atomic<size_t> m_max_diepte{ 0 };
+	std::atomic<uint64_t> m_geschreven{ 0 }, m_verworpen{ 0 }, m_batches{ 0 }, m_fouten{ 0 };
+	std::atomic<float> m_laatste_duur_ms{ 0 };
+
+	// the size of the failed batch waiting to be retried
+	std::atomic<size_t> m_opnieuw{ 0 };
+
+	Teller &m_verworpen_teller, &m_fouten_teller;
+
+	std::jthread m_thread;
+};
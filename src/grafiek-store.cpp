@@ -0,0 +1,303 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grafiek-store.hpp"
+
+#include <date/tz.h>
+
+#include <algorithm>
+#include <iostream>
+
+// --------------------------------------------------------------------
+// Aggregation kernels. Each keeps eight independent partial results so
+// the compiler can map the inner loop onto SIMD registers without
+// having to reorder floating point operations.
+
+namespace
+{
+
+const size_t kLanes = 8;
+
+float kolom_som(const float *v, size_t n)
+{
+	float p[kLanes] = {};
+
+	size_t i = 0;
+	for (; i + kLanes <= n; i += kLanes)
+	{
+		for (size_t j = 0; j < kLanes; ++j)
+			p[j] += v[i + j];
+	}
+
+	float result = 0;
+	for (; i < n; ++i)
+		result += v[i];
+	for (size_t j = 0; j < kLanes; ++j)
+		result += p[j];
+
+	return result;
+}
+
+float kolom_min(const float *v, size_t n)
+{
+	float p[kLanes];
+	std::fill(p, p + kLanes, v[0]);
+
+	size_t i = 0;
+	for (; i + kLanes <= n; i += kLanes)
+	{
+		for (size_t j = 0; j < kLanes; ++j)
+			p[j] = std::min(p[j], v[i + j]);
+	}
+
+	float result = v[0];
+	for (; i < n; ++i)
+		result = std::min(result, v[i]);
+	for (size_t j = 0; j < kLanes; ++j)
+		result = std::min(result, p[j]);
+
+	return result;
+}
+
+float kolom_max(const float *v, size_t n)
+{
+	float p[kLanes];
+	std::fill(p, p + kLanes, v[0]);
+
+	size_t i = 0;
+	for (; i + kLanes <= n; i += kLanes)
+	{
+		for (size_t j = 0; j < kLanes; ++j)
+			p[j] = std::max(p[j], v[i + j]);
+	}
+
+	float result = v[0];
+	for (; i < n; ++i)
+		result = std::max(result, v[i]);
+	for (size_t j = 0; j < kLanes; ++j)
+		result = std::max(result, p[j]);
+
+	return result;
+}
+
+date::local_days lokale_dag(std::chrono::system_clock::time_point t)
+{
+	return date::floor<date::days>(date::make_zoned(date::current_zone(), t).get_local_time());
+}
+
+} // namespace
+
+// --------------------------------------------------------------------
+
+bool GrafiekStore::Dag::append(const GrafiekPunt &pt)
+{
+	auto t = date::floor<std::chrono::seconds>(pt.tijd);
+
+	if (delta.empty())
+	{
+		basis = t;
+		delta.push_back(0);
+	}
+	else if (t < laatste)
+		return false;
+	else
+		delta.push_back(static_cast<uint32_t>((t - laatste).count()));
+
+	laatste = t;
+
+	for (size_t k = 0; k < kAantalGrafiekVelden; ++k)
+		kolommen[k].push_back(pt.*kGrafiekVelden[k].veld);
+
+	return true;
+}
+
+std::vector<date::sys_seconds> GrafiekStore::Dag::tijden() const
+{
+	std::vector<date::sys_seconds> result(delta.size());
+
+	auto t = basis;
+	for (size_t i = 0; i < delta.size(); ++i)
+	{
+		t += std::chrono::seconds{ delta[i] };
+		result[i] = t;
+	}
+
+	return result;
+}
+
+GrafiekPunt GrafiekStore::Dag::punt(size_t i, date::sys_seconds tijd) const
+{
+	GrafiekPunt result{ .tijd = tijd };
+
+	for (size_t k = 0; k < kAantalGrafiekVelden; ++k)
+		result.*kGrafiekVelden[k].veld = kolommen[k][i];
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+GrafiekStore::GrafiekStore(size_t dagen)
+	: m_dagen(std::max(dagen, size_t{ 1 }))
+{
+}
+
+void GrafiekStore::append(const GrafiekPunt &pt)
+{
+	std::unique_lock lock(m_mutex);
+	append_locked(pt);
+}
+
+void GrafiekStore::append_locked(const GrafiekPunt &pt)
+{
+	auto dag = lokale_dag(pt.tijd);
+
+	if (not m_data[dag].append(pt))
+	{
+		std::clog << "Dropped a status graph sample at " << date::format("%FT%TZ", date::floor<std::chrono::seconds>(pt.tijd))
+				  << ", it is older than the last sample of that day\n";
+		return;
+	}
+
+	// drop the days that fell out of the window
+	auto eerste = dag - date::days{ static_cast<int>(m_dagen) - 1 };
+
+	m_data.erase(m_data.begin(), m_data.lower_bound(eerste));
+
+	if (m_vanaf and *m_vanaf < eerste)
+		m_vanaf = eerste;
+}
+
+void GrafiekStore::warm(date::local_days vanaf, const std::vector<GrafiekPunt> &data)
+{
+	std::unique_lock lock(m_mutex);
+
+	auto live = std::exchange(m_data, {});
+
+	auto laatste = date::sys_seconds::min();
+	if (not data.empty())
+		laatste = date::floor<std::chrono::seconds>(data.back().tijd);
+
+	m_vanaf = vanaf;
+
+	for (auto &pt : data)
+		append_locked(pt);
+
+	for (auto &[dag, d] : live)
+	{
+		auto tijden = d.tijden();
+		for (size_t i = 0; i < d.size(); ++i)
+		{
+			if (tijden[i] > laatste)
+				append_locked(d.punt(i, tijden[i]));
+		}
+	}
+}
+
+std::optional<std::vector<GrafiekPunt>> GrafiekStore::grafiekVoorDag(date::year_month_day ymd, std::chrono::minutes resolutie, bool raw,
+	std::optional<std::chrono::system_clock::time_point> sinds) const
+{
+	using namespace std::literals;
+
+	date::local_days dag{ ymd };
+
+	std::shared_lock lock(m_mutex);
+
+	if (not m_vanaf or dag < *m_vanaf)
+		return std::nullopt;
+
+	std::vector<GrafiekPunt> result;
+
+	auto i = m_data.find(dag);
+	if (i == m_data.end())
+		return result;
+
+	auto &d = i->second;
+	auto tijden = d.tijden();
+	size_t N = d.size();
+
+	if (raw)
+	{
+		size_t b = 0;
+		if (sinds)
+			b = std::lower_bound(tijden.begin(), tijden.end(), date::floor<std::chrono::seconds>(*sinds)) - tijden.begin();
+
+		result.reserve(N - b);
+		for (size_t j = b; j < N; ++j)
+			result.emplace_back(d.punt(j, tijden[j]));
+		return result;
+	}
+
+	auto begin = date::make_zoned(date::current_zone(), dag).get_sys_time();
+	auto end = begin + 24h;
+
+	// Only the last intervals are needed for an update, skip the rest
+	if (sinds and *sinds > begin)
+		begin += ((*sinds - begin) / resolutie) * resolutie;
+
+	size_t b = std::lower_bound(tijden.begin(), tijden.end(), begin) - tijden.begin();
+	for (auto t = begin; t < end; t += resolutie)
+	{
+		while (b < N and tijden[b] < t)
+			++b;
+
+		size_t e = b;
+		while (e < N and tijden[e] < t + resolutie)
+			++e;
+
+		if (e == b)
+			continue;
+
+		GrafiekPunt pt{ .tijd = t };
+
+		for (size_t k = 0; k < kAantalGrafiekVelden; ++k)
+		{
+			const float *v = d.kolommen[k].data() + b;
+			size_t n = e - b;
+
+			switch (kGrafiekVelden[k].aggregatie)
+			{
+				case GrafiekAggregatie::gemiddelde:
+					pt.*kGrafiekVelden[k].veld = kolom_som(v, n) / n;
+					break;
+				case GrafiekAggregatie::minimum:
+					pt.*kGrafiekVelden[k].veld = kolom_min(v, n);
+					break;
+				case GrafiekAggregatie::maximum:
+					pt.*kGrafiekVelden[k].veld = kolom_max(v, n);
+					break;
+				case GrafiekAggregatie::som:
+					pt.*kGrafiekVelden[k].veld = kolom_som(v, n);
+					break;
+			}
+		}
+
+		result.emplace_back(std::move(pt));
+		b = e;
+	}
+
+	return result;
+}
@@ -0,0 +1,97 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "data-service.hpp"
+
+#include <date/date.h>
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+// --------------------------------------------------------------------
+// In memory store for the status graph samples of the last few days.
+// Each day is kept as a struct of arrays: the timestamps as deltas in
+// seconds and one float column per field of GrafiekPunt. The store is
+// fed by the collector and warmed from the database at startup.
+
+class GrafiekStore
+{
+  public:
+	GrafiekStore(size_t dagen);
+
+	GrafiekStore(const GrafiekStore &) = delete;
+	GrafiekStore &operator=(const GrafiekStore &) = delete;
+
+	size_t get_dagen() const
+	{
+		return m_dagen;
+	}
+
+	// Samples are expected to arrive in chronological order, a sample
+	// older than the last one of its day is dropped
+	void append(const GrafiekPunt &pt);
+
+	// Replace the contents with the data loaded from the database,
+	// starting at day vanaf. Samples appended since are kept.
+	void warm(date::local_days vanaf, const std::vector<GrafiekPunt> &data);
+
+	// Returns std::nullopt if dag is not available in this store. With
+	// sinds only the points at or after sinds are returned, for aggregated
+	// points starting with the interval that contains sinds.
+	std::optional<std::vector<GrafiekPunt>> grafiekVoorDag(date::year_month_day dag, std::chrono::minutes resolutie, bool raw,
+		std::optional<std::chrono::system_clock::time_point> sinds = {}) const;
+
+  private:
+	struct Dag
+	{
+		date::sys_seconds basis, laatste;
+		std::vector<uint32_t> delta;
+		std::array<std::vector<float>, kAantalGrafiekVelden> kolommen;
+
+		size_t size() const
+		{
+			return delta.size();
+		}
+
+		// Returns false, and does not add it, if pt is older than laatste
+		bool append(const GrafiekPunt &pt);
+		std::vector<date::sys_seconds> tijden() const;
+		GrafiekPunt punt(size_t i, date::sys_seconds tijd) const;
+	};
+
+	void append_locked(const GrafiekPunt &pt);
+
+	size_t m_dagen;
+	mutable std::shared_mutex m_mutex;
+	std::map<date::local_days, Dag> m_data;
+	std::optional<date::local_days> m_vanaf;
+};
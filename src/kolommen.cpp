@@ -0,0 +1,137 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "kolommen.hpp"
+
+#include <date/date.h>
+
+#include <charconv>
+#include <limits>
+
+// --------------------------------------------------------------------
+
+KolomSchrijver::KolomSchrijver(std::string_view start, std::chrono::seconds stap, size_t aantal)
+	: m_aantal(aantal)
+{
+	m_json.reserve(64 + aantal * 8);
+
+	m_json += R"({"start":")";
+	m_json += start;
+	m_json += R"(","stap":)";
+	m_json += std::to_string(stap.count());
+	m_json += R"(,"aantal":)";
+	m_json += std::to_string(aantal);
+}
+
+std::string KolomSchrijver::str() &&
+{
+	m_json += '}';
+	return std::move(m_json);
+}
+
+void KolomSchrijver::begin_kolom(std::string_view naam)
+{
+	m_json += ",\"";
+	m_json += naam;
+	m_json += "\":[";
+}
+
+void KolomSchrijver::getal(size_t i, float v, int precisie)
+{
+	if (i > 0)
+		m_json += ',';
+
+	if (not std::isfinite(v))
+	{
+		m_json += "null";
+		return;
+	}
+
+	char buffer[32];
+	auto [e, ec] = std::to_chars(buffer, buffer + sizeof(buffer), v, std::chars_format::fixed, precisie);
+	if (ec != std::errc{})
+	{
+		m_json += "null";
+		return;
+	}
+
+	// drop trailing zeros, 12.50 is written as 12.5 and 3.00 as 3
+	if (precisie > 0)
+	{
+		while (e[-1] == '0')
+			--e;
+		if (e[-1] == '.')
+			--e;
+	}
+
+	std::string_view s(buffer, e - buffer);
+	if (s == "-0")
+		s = "0";
+
+	m_json += s;
+}
+
+// --------------------------------------------------------------------
+
+std::string grafiek_kolommen(const std::vector<GrafiekPunt> &data,
+	std::chrono::system_clock::time_point start, std::chrono::seconds stap)
+{
+	using namespace std::chrono;
+
+	// The point to use for each slot, points that round to the same slot
+	// are rare, the last one wins.
+	std::vector<const GrafiekPunt *> slots;
+
+	for (auto &pt : data)
+	{
+		if (pt.tijd < start)
+			continue;
+
+		auto i = static_cast<size_t>((duration_cast<milliseconds>(pt.tijd - start) + stap / 2) / stap);
+		if (i >= slots.size())
+			slots.resize(i + 1);
+		slots[i] = &pt;
+	}
+
+	KolomSchrijver schrijver(date::format("%FT%TZ", floor<seconds>(start)), stap, slots.size());
+
+	for (auto &v : kGrafiekVelden)
+	{
+		// power to one decimal, energy to two, the state of charge is a fraction
+		int precisie = 1;
+		if (v.veld == &GrafiekPunt::laad_niveau)
+			precisie = 3;
+		else if (v.aggregatie == GrafiekAggregatie::som)
+			precisie = 2;
+
+		schrijver.kolom(v.naam, precisie,
+			[&slots, veld = v.veld](size_t i)
+			{ return slots[i] ? slots[i]->*veld : std::numeric_limits<float>::quiet_NaN(); });
+	}
+
+	return std::move(schrijver).str();
+}
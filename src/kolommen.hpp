@@ -0,0 +1,74 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include "data-service.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// --------------------------------------------------------------------
+// Writes a time series as a single JSON object with a start time, a
+// fixed step in seconds and one array per value, instead of an array
+// of objects that repeats every key and timestamp. Slot i is at time
+// start + i * stap, slots without a value are written as null.
+// The JSON is written directly, no zeep::json::element tree is built.
+
+class KolomSchrijver
+{
+  public:
+	KolomSchrijver(std::string_view start, std::chrono::seconds stap, size_t aantal);
+
+	// Adds the column naam, waarde(i) returns the value for slot i,
+	// or NaN when there is none.
+	template <typename F>
+	void kolom(std::string_view naam, int precisie, F &&waarde)
+	{
+		begin_kolom(naam);
+		for (size_t i = 0; i < m_aantal; ++i)
+			getal(i, waarde(i), precisie);
+		m_json += ']';
+	}
+
+	std::string str() &&;
+
+  private:
+	void begin_kolom(std::string_view naam);
+	void getal(size_t i, float v, int precisie);
+
+	std::string m_json;
+	size_t m_aantal;
+};
+
+// The status graph points in columnar form, the time of each point is
+// rounded to the nearest multiple of stap after start.
+std::string grafiek_kolommen(const std::vector<GrafiekPunt> &data,
+	std::chrono::system_clock::time_point start, std::chrono::seconds stap);
@@ -0,0 +1,265 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "metrics.hpp"
+
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+// --------------------------------------------------------------------
+
+size_t metriek_shard()
+{
+	static std::atomic<size_t> s_volgende{ 0 };
+	thread_local size_t t_shard = s_volgende.fetch_add(1, std::memory_order_relaxed) % kMetriekShards;
+	return t_shard;
+}
+
+// --------------------------------------------------------------------
+
+uint64_t Teller::waarde() const
+{
+	uint64_t result = 0;
+	for (auto &s : m_shards)
+		result += s.waarde.load(std::memory_order_relaxed);
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+namespace
+{
+
+constexpr auto kGrenzenNs = []()
+{
+	std::array<int64_t, Histogram::kGrenzen.size()> result{};
+	for (size_t i = 0; i < result.size(); ++i)
+		result[i] = static_cast<int64_t>(Histogram::kGrenzen[i] * 1e9);
+	return result;
+}();
+
+} // namespace
+
+void Histogram::observe(std::chrono::steady_clock::duration d)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+	if (ns < 0)
+		ns = 0;
+
+	size_t i = 0;
+	while (i < kGrenzenNs.size() and ns > kGrenzenNs[i])
+		++i;
+
+	auto &shard = m_shards[metriek_shard()];
+	shard.buckets[i].fetch_add(1, std::memory_order_relaxed);
+	shard.som_ns.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+}
+
+Histogram::Stand Histogram::stand() const
+{
+	Stand result;
+	uint64_t som_ns = 0;
+
+	for (auto &s : m_shards)
+	{
+		for (size_t i = 0; i < kAantalBuckets; ++i)
+			result.buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+		som_ns += s.som_ns.load(std::memory_order_relaxed);
+	}
+
+	for (auto n : result.buckets)
+		result.aantal += n;
+
+	result.som = som_ns / 1e9;
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+namespace
+{
+
+std::string label_tekst(const MetriekLabels &labels)
+{
+	std::string result;
+
+	for (auto &[naam, waarde] : labels)
+	{
+		if (not result.empty())
+			result += ',';
+
+		result += naam;
+		result += "=\"";
+
+		for (char ch : waarde)
+		{
+			switch (ch)
+			{
+				case '\\': result += "\\\\"; break;
+				case '"': result += "\\\""; break;
+				case '\n': result += "\\n"; break;
+				default: result += ch;
+			}
+		}
+
+		result += '"';
+	}
+
+	return result;
+}
+
+// Adds the le label to the labels of a histogram bucket
+std::string met_le(const std::string &labels, const std::string &le)
+{
+	return '{' + labels + (labels.empty() ? "" : ",") + "le=\"" + le + "\"}";
+}
+
+std::string met_haakjes(const std::string &labels)
+{
+	return labels.empty() ? std::string{} : '{' + labels + '}';
+}
+
+} // namespace
+
+std::unique_ptr<Metrieken> Metrieken::s_instance;
+
+Metrieken &Metrieken::instance()
+{
+	static std::once_flag s_once;
+	std::call_once(s_once, []()
+		{ s_instance.reset(new Metrieken); });
+	return *s_instance;
+}
+
+template <typename M>
+M &Metrieken::zoek(std::map<std::string, std::unique_ptr<M>> Familie::*metrieken,
+	const std::string &naam, const std::string &help, const MetriekLabels &labels)
+{
+	auto key = label_tekst(labels);
+
+	{
+		std::shared_lock lock(m_mutex);
+
+		if (auto f = m_families.find(naam); f != m_families.end())
+		{
+			auto &m = f->second.*metrieken;
+			if (auto i = m.find(key); i != m.end())
+				return *i->second;
+		}
+	}
+
+	std::unique_lock lock(m_mutex);
+
+	auto &familie = m_families[naam];
+	if (familie.help.empty())
+		familie.help = help;
+
+	auto &m = (familie.*metrieken)[key];
+	if (not m)
+		m = std::make_unique<M>();
+
+	return *m;
+}
+
+Teller &Metrieken::teller(const std::string &naam, const std::string &help, const MetriekLabels &labels)
+{
+	return zoek(&Familie::tellers, naam, help, labels);
+}
+
+Histogram &Metrieken::histogram(const std::string &naam, const std::string &help, const MetriekLabels &labels)
+{
+	return zoek(&Familie::histogrammen, naam, help, labels);
+}
+
+void Metrieken::meter(const std::string &naam, const std::string &help, std::function<double()> waarde, const MetriekLabels &labels)
+{
+	std::unique_lock lock(m_mutex);
+
+	auto &familie = m_families[naam];
+	if (familie.help.empty())
+		familie.help = help;
+
+	familie.meters[label_tekst(labels)] = std::move(waarde);
+}
+
+void Metrieken::schrijf(std::ostream &os) const
+{
+	std::shared_lock lock(m_mutex);
+
+	for (auto &[naam, familie] : m_families)
+	{
+		os << "# HELP " << naam << ' ' << familie.help << '\n';
+
+		if (not familie.tellers.empty())
+		{
+			os << "# TYPE " << naam << " counter\n";
+
+			for (auto &[labels, teller] : familie.tellers)
+				os << naam << met_haakjes(labels) << ' ' << teller->waarde() << '\n';
+		}
+		else if (not familie.meters.empty())
+		{
+			os << "# TYPE " << naam << " gauge\n";
+
+			for (auto &[labels, waarde] : familie.meters)
+				os << naam << met_haakjes(labels) << ' ' << waarde() << '\n';
+		}
+		else
+		{
+			os << "# TYPE " << naam << " histogram\n";
+
+			for (auto &[labels, histogram] : familie.histogrammen)
+			{
+				auto stand = histogram->stand();
+
+				uint64_t cumulatief = 0;
+				for (size_t i = 0; i < Histogram::kGrenzen.size(); ++i)
+				{
+					cumulatief += stand.buckets[i];
+
+					std::ostringstream le;
+					le << Histogram::kGrenzen[i];
+					os << naam << "_bucket" << met_le(labels, le.str()) << ' ' << cumulatief << '\n';
+				}
+
+				os << naam << "_bucket" << met_le(labels, "+Inf") << ' ' << stand.aantal << '\n'
+				   << naam << "_sum" << met_haakjes(labels) << ' ' << std::setprecision(9) << stand.som << '\n'
+				   << naam << "_count" << met_haakjes(labels) << ' ' << stand.aantal << '\n';
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+
+Histogram &db_query_histogram(const std::string &query)
+{
+	return Metrieken::instance().histogram("energyd_db_query_seconds",
+		"Latency of database queries", { { "query", query } });
+}
@@ -0,0 +1,172 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --------------------------------------------------------------------
+// Counters and latency histograms, exported in the Prometheus text
+// format. Updates go to one of a fixed number of cache line aligned
+// shards, each thread always uses the same shard. An update is then a
+// single relaxed atomic add that does not contend with other threads,
+// only reading the value has to sum the shards.
+
+inline constexpr size_t kMetriekShards = 16;
+
+// The shard used by the calling thread
+size_t metriek_shard();
+
+class Teller
+{
+  public:
+	void inc(uint64_t n = 1)
+	{
+		m_shards[metriek_shard()].waarde.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	uint64_t waarde() const;
+
+  private:
+	struct alignas(64) Shard
+	{
+		std::atomic<uint64_t> waarde{ 0 };
+	};
+
+	std::array<Shard, kMetriekShards> m_shards;
+};
+
+class Histogram
+{
+  public:
+	// The upper bounds of the buckets in seconds, the last bucket is +Inf
+	static constexpr std::array<double, 14> kGrenzen{
+		0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+	};
+
+	static constexpr size_t kAantalBuckets = kGrenzen.size() + 1;
+
+	void observe(std::chrono::steady_clock::duration d);
+
+	struct Stand
+	{
+		std::array<uint64_t, kAantalBuckets> buckets{};
+		uint64_t aantal = 0;
+		double som = 0;
+	};
+
+	Stand stand() const;
+
+  private:
+	struct alignas(64) Shard
+	{
+		std::array<std::atomic<uint64_t>, kAantalBuckets> buckets{};
+		std::atomic<uint64_t> som_ns{ 0 };
+	};
+
+	std::array<Shard, kMetriekShards> m_shards;
+};
+
+// Records the time from construction to destruction in a histogram
+class MeetTijd
+{
+  public:
+	explicit MeetTijd(Histogram &histogram)
+		: m_histogram(histogram)
+		, m_start(std::chrono::steady_clock::now())
+	{
+	}
+
+	MeetTijd(const MeetTijd &) = delete;
+	MeetTijd &operator=(const MeetTijd &) = delete;
+
+	~MeetTijd()
+	{
+		m_histogram.observe(std::chrono::steady_clock::now() - m_start);
+	}
+
+  private:
+	Histogram &m_histogram;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+// --------------------------------------------------------------------
+// All metrics by name and labels. Looking up a metric takes a lock, so
+// code on a hot path looks it up once and keeps the reference, metrics
+// are never removed.
+
+using MetriekLabels = std::vector<std::pair<std::string, std::string>>;
+
+class Metrieken
+{
+  public:
+	static Metrieken &instance();
+
+	Teller &teller(const std::string &naam, const std::string &help, const MetriekLabels &labels = {});
+	Histogram &histogram(const std::string &naam, const std::string &help, const MetriekLabels &labels = {});
+
+	// A gauge, its value is obtained by calling waarde when the metrics
+	// are written. Registering the same name and labels again replaces it.
+	void meter(const std::string &naam, const std::string &help, std::function<double()> waarde, const MetriekLabels &labels = {});
+
+	// Write all metrics in the Prometheus text exposition format
+	void schrijf(std::ostream &os) const;
+
+  private:
+	Metrieken() = default;
+
+	struct Familie
+	{
+		std::string help;
+		std::map<std::string, std::unique_ptr<Teller>> tellers;
+		std::map<std::string, std::unique_ptr<Histogram>> histogrammen;
+		std::map<std::string, std::function<double()>> meters;
+	};
+
+	template <typename M>
+	M &zoek(std::map<std::string, std::unique_ptr<M>> Familie::*metrieken,
+		const std::string &naam, const std::string &help, const MetriekLabels &labels);
+
+	mutable std::shared_mutex m_mutex;
+	std::map<std::string, Familie> m_families;
+
+	static std::unique_ptr<Metrieken> s_instance;
+};
+
+// The latency histogram of a database query, by name
+Histogram &db_query_histogram(const std::string &query);
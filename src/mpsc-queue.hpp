@@ -0,0 +1,133 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+
+// --------------------------------------------------------------------
+// A bounded lock-free queue for multiple producers and a single
+// consumer, after Dmitry Vyukov's bounded MPMC queue. Each cell carries
+// a sequence number telling whether it is free for the producer at that
+// position or filled for the consumer. Producers claim a position with
+// a CAS, the consumer needs no atomic read-modify-write at all.
+
+template <typename T>
+class MPSCQueue
+{
+  public:
+	// capacity is rounded up to a power of two
+	explicit MPSCQueue(size_t capacity)
+		: m_capacity(std::bit_ceil(std::max<size_t>(capacity, 2)))
+		, m_mask(m_capacity - 1)
+		, m_cellen(new Cel[m_capacity])
+	{
+		for (size_t i = 0; i < m_capacity; ++i)
+			m_cellen[i].volgnummer.store(i, std::memory_order_relaxed);
+	}
+
+	MPSCQueue(const MPSCQueue &) = delete;
+	MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+	// Returns false when the queue is full, never blocks
+	bool push(const T &v)
+	{
+		auto pos = m_kop.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			auto &cel = m_cellen[pos & m_mask];
+			auto volgnummer = cel.volgnummer.load(std::memory_order_acquire);
+			auto verschil = static_cast<std::ptrdiff_t>(volgnummer - pos);
+
+			if (verschil == 0)
+			{
+				if (m_kop.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cel.waarde = v;
+					cel.volgnummer.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (verschil < 0)
+				return false;
+			else
+				pos = m_kop.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Only to be called from the single consumer thread
+	bool pop(T &v)
+	{
+		auto pos = m_staart.load(std::memory_order_relaxed);
+		auto &cel = m_cellen[pos & m_mask];
+
+		if (cel.volgnummer.load(std::memory_order_acquire) != pos + 1)
+			return false;
+
+		v = std::move(cel.waarde);
+		cel.volgnummer.store(pos + m_capacity, std::memory_order_release);
+		m_staart.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Approximate number of elements, exact when no push or pop is running
+	size_t size() const
+	{
+		auto staart = m_staart.load(std::memory_order_acquire);
+		auto kop = m_kop.load(std::memory_order_acquire);
+		return kop > staart ? kop - staart : 0;
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+
+  private:
+	struct Cel
+	{
+		std::atomic<size_t> volgnummer;
+		T waarde;
+	};
+
+	const size_t m_capacity, m_mask;
+	std::unique_ptr<Cel[]> m_cellen;
+
+	// keep producer and consumer positions on separate cache lines
+	alignas(64) std::atomic<size_t> m_kop{ 0 };
+	alignas(64) std::atomic<size_t> m_staart{ 0 };
+};
@@ -24,7 +24,10 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "gezondheid.hpp"
+#include "metrics.hpp"
 #include "p1-service.hpp"
+#include "trace.hpp"
 
 #include <mcfp/mcfp.hpp>
 
@@ -37,9 +40,27 @@
 
 std::unique_ptr<P1Service> P1Service::s_instance;
 
-P1Service &P1Service::init(boost::asio::io_context &io_context)
+namespace
 {
-	s_instance.reset(new P1Service(io_context));
+
+struct P1Metrieken
+{
+	Teller &telegrammen = Metrieken::instance().teller("energyd_p1_telegrams_total", "P1 telegrams read successfully");
+	Teller &crc_fouten = Metrieken::instance().teller("energyd_p1_crc_failures_total", "P1 telegrams with a checksum that did not match");
+	Histogram &parse_tijd = Metrieken::instance().histogram("energyd_p1_parse_seconds", "Time to parse a P1 telegram");
+};
+
+P1Metrieken &p1_metrieken()
+{
+	static P1Metrieken s_metrieken;
+	return s_metrieken;
+}
+
+} // namespace
+
+P1Service &P1Service::init()
+{
+	s_instance.reset(new P1Service());
 	return *s_instance;
 }
 
@@ -51,39 +72,71 @@ P1Service &P1Service::instance()
 	return *s_instance;
 }
 
-P1Service::P1Service(boost::asio::io_context &io_context)
-	: m_io_context(io_context)
+void P1Service::stop()
+{
+	s_instance.reset();
+}
+
+P1Service::P1Service()
 {
 	auto &config = mcfp::config::instance();
 
 	m_device_string = config.get("p1-device");
 
+	// The first telegram is read by the thread, the meter sends one
+	// per second so there is no need to wait for it here
 	if (std::filesystem::exists(m_device_string))
 	{
-		std::tie(m_opname, std::ignore) = read();
-		m_thread = std::thread(std::bind(&P1Service::run, this));
+		Gezondheid::instance().meld("p1", Toestand::opstarten);
+		m_thread = std::jthread([this](std::stop_token stop)
+			{ run(stop); });
 	}
 }
 
-void P1Service::run()
+P1Service::~P1Service()
+{
+	m_thread.request_stop();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void P1Service::run(std::stop_token stop)
 {
 	using namespace std::literals;
 
-	for (;;)
+	if (Trace::actief())
+		Trace::instance().thread_naam("p1");
+
+	while (not stop.stop_requested())
 	{
 		try
 		{
-			auto [opname, status] = read();
+			auto telegram = read(stop);
+			if (not telegram)
+				break;
+
+			auto [opname, status] = *telegram;
+			auto now = std::chrono::system_clock::now();
 
 			{
 				std::unique_lock lock(m_mutex);
 				m_opname = opname;
 				m_status = status;
+				m_gelezen = true;
+
+				m_verbruik.add(now, 1000 * status.power_consumed);
+				m_levering.add(now, 1000 * status.power_produced);
 			}
+
+			Gezondheid::instance().meld("p1", Toestand::gereed);
 		}
 		catch (const std::exception &e)
 		{
 			std::cerr << e.what() << '\n';
+			Gezondheid::instance().meld("p1", Toestand::fout, e.what());
+
+			// do not spin when the device is gone
+			slaap_tot(stop, std::chrono::steady_clock::now() + 1s);
 		}
 	}
 }
@@ -102,9 +155,11 @@ const std::regex
 // 1-0:1.7.0(00.184*kW)
 // 1-0:2.7.0(00.169*kW)
 
-P1Opname P1Service::get_current() const
+std::optional<P1Opname> P1Service::get_current() const
 {
 	std::unique_lock lock(m_mutex);
+	if (not m_gelezen)
+		return {};
 	return m_opname;
 }
 
@@ -114,6 +169,12 @@ P1Status P1Service::get_status() const
 	return m_status;
 }
 
+std::tuple<IntervalWaarde, IntervalWaarde> P1Service::take_interval(std::chrono::system_clock::time_point t)
+{
+	std::unique_lock lock(m_mutex);
+	return { m_verbruik.take(t), m_levering.take(t) };
+}
+
 inline uint16_t update_crc(uint16_t crc, char ch)
 {
 	const uint16_t polynomial = 0xa001;
@@ -132,12 +193,16 @@ inline uint16_t update_crc(uint16_t crc, char ch)
 	return result;
 }
 
-std::tuple<P1Opname, P1Status> P1Service::read() const
+std::optional<std::tuple<P1Opname, P1Status>> P1Service::read(std::stop_token stop)
 {
+	using namespace std::literals;
+
+	TraceSpan span("p1", "read");
+
 	P1Opname opname{};
 	P1Status status{};
 
-	boost::asio::serial_port p1(m_io_context.get_executor());
+	boost::asio::serial_port p1(m_io_context);
 
 	boost::system::error_code ec;
 	p1.open(m_device_string, ec);
@@ -170,10 +235,37 @@ std::tuple<P1Opname, P1Status> P1Service::read() const
 		boost::asio::streambuf data;
 		boost::asio::streambuf::mutable_buffers_type bufs = data.prepare(512);
 
-		auto n = p1.read_some(bufs, ec);
+		size_t n = 0;
+		p1.async_read_some(bufs, [&ec, &n](const boost::system::error_code &e, size_t len)
+			{
+			ec = e;
+			n = len; });
+
+		// Run the read in short steps to notice a stop request. A
+		// cancelled read still completes, after that the port can
+		// be closed cleanly.
+		m_io_context.restart();
+		while (m_io_context.run_one_for(100ms) == 0)
+		{
+			if (stop.stop_requested())
+			{
+				boost::system::error_code ignore;
+				p1.cancel(ignore);
+			}
+		}
+
+		if (stop.stop_requested())
+		{
+			boost::system::error_code ignore;
+			p1.close(ignore);
+			return {};
+		}
+
+		if (ec)
+			throw std::system_error(ec, "Error reading serial device");
 
-		if (n == 0 or ec)
-			break;
+		if (n == 0)
+			throw std::runtime_error("No data from serial device");
 
 		data.commit(n);
 
@@ -260,6 +352,8 @@ std::tuple<P1Opname, P1Status> P1Service::read() const
 					crc_s += ch;
 					if (crc_s.length() == 6)
 					{
+						TraceSpan crc_span("p1", "crc");
+
 						if (crc_s[4] != '\r' or crc_s[5] != '\n')
 						{
 							std::cerr << "Unexpected end of message\n";
@@ -271,12 +365,16 @@ std::tuple<P1Opname, P1Status> P1Service::read() const
 
 						if (test != crc)
 						{
+							p1_metrieken().crc_fouten.inc();
 							std::cerr << "CRC did not match\n";
 							state = START;
 							crc = 0;
 							break;
 						}
 
+						MeetTijd meting(p1_metrieken().parse_tijd);
+						TraceSpan parse_span("p1", "parse");
+
 						auto begin = std::sregex_iterator(message.begin(), message.end(), kReadRX);
 						auto end = std::sregex_iterator();
 
@@ -312,6 +410,8 @@ std::tuple<P1Opname, P1Status> P1Service::read() const
 							}
 						}
 
+						p1_metrieken().telegrammen.inc();
+
 						state = DONE;
 						crc = 0;
 					}
@@ -323,5 +423,7 @@ std::tuple<P1Opname, P1Status> P1Service::read() const
 		}
 	}
 
-	return { opname, status };
+	p1.close(ec);
+
+	return std::make_tuple(opname, status);
 }
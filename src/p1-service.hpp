@@ -26,37 +26,55 @@
 
 #pragma once
 
+#include "accumulator.hpp"
 #include "data-service.hpp"
 
 #include <boost/asio.hpp>
 
+#include <optional>
 #include <thread>
 
 class P1Service
 {
   public:
 
-	static P1Service &init(boost::asio::io_context &io_context);
+	static P1Service &init();
 	static P1Service &instance();
 
-	P1Opname get_current() const;
+	// Stops reading, a read in progress is cancelled and the serial
+	// port is closed
+	static void stop();
+
+	~P1Service();
+
+	// Empty until the first telegram was read
+	std::optional<P1Opname> get_current() const;
 	P1Status get_status() const;
 
+	// Returns the power consumed and produced in W integrated over
+	// all telegrams since the previous call
+	std::tuple<IntervalWaarde, IntervalWaarde> take_interval(std::chrono::system_clock::time_point t);
+
   private:
-	P1Service(boost::asio::io_context &io_context);
+	P1Service();
 
-	void run();
+	void run(std::stop_token stop);
 
-	std::tuple<P1Opname,P1Status> read() const;
+	// Returns an empty optional when stopped
+	std::optional<std::tuple<P1Opname, P1Status>> read(std::stop_token stop);
 
 	std::string m_device_string;
-	std::thread m_thread;
 
 	mutable std::mutex m_mutex;
 	P1Opname m_opname{};
+	bool m_gelezen = false;
 	P1Status m_status{};
+	IntervalAccumulator m_verbruik, m_levering;
 
-	boost::asio::io_context &m_io_context;
+	// Only used by the reading thread, the serial port is read
+	// asynchronously so a stop request is noticed
+	boost::asio::io_context m_io_context;
+	std::jthread m_thread;
 
 	static std::unique_ptr<P1Service> s_instance;
 };
@@ -25,8 +25,11 @@
  */
 
 #include "data-service.hpp"
+#include "gezondheid.hpp"
 #include "sessy-service.hpp"
 #include "https-client.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 
 #include <mcfp/mcfp.hpp>
 
@@ -52,16 +55,101 @@ SessyService &SessyService::instance()
 	return *s_instance;
 }
 
+void SessyService::stop()
+{
+	s_instance.reset();
+}
+
 SessyService::SessyService(boost::asio::io_context &io_context)
 	: m_io_context(io_context)
 {
+	auto &config = mcfp::config::instance();
+
+	m_poll_interval = std::chrono::seconds{ std::max(config.get<int>("sessy-poll-interval"), 1) };
+
+	bool configured = false;
+	for (int sessy_nr = 1; sessy_nr <= 6 and not configured; ++sessy_nr)
+		configured = config.has("sessy-" + std::to_string(sessy_nr));
+
+	if (configured)
+	{
+		Gezondheid::instance().meld("sessy", Toestand::opstarten);
+		m_thread = std::jthread([this](std::stop_token stop)
+			{ run(stop); });
+	}
+}
+
+SessyService::~SessyService()
+{
+	m_thread.request_stop();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void SessyService::run(std::stop_token stop)
+{
+	if (Trace::actief())
+		Trace::instance().thread_naam("sessy");
+
+	while (not stop.stop_requested())
+	{
+		auto next = std::chrono::steady_clock::now() + m_poll_interval;
+
+		try
+		{
+			auto soc = read();
+			auto now = std::chrono::system_clock::now();
+
+			float zon = 0, batterij = 0, laad_niveau = 0;
+			for (auto &s : soc)
+			{
+				zon += s.phase[0].power + s.phase[1].power + s.phase[2].power;
+				batterij += s.sessy.power;
+				laad_niveau += s.sessy.state_of_charge;
+			}
+
+			std::unique_lock lock(m_mutex);
+
+			if (not soc.empty())
+			{
+				m_zon.add(now, zon);
+				m_batterij.add(now, batterij);
+				m_laad_niveau.add(now, laad_niveau / soc.size());
+			}
+
+			m_soc = std::move(soc);
+			m_polled = true;
+			lock.unlock();
+
+			Gezondheid::instance().meld("sessy", Toestand::gereed);
+		}
+		catch (const std::exception &e)
+		{
+			std::cerr << e.what() << '\n';
+			Gezondheid::instance().meld("sessy", Toestand::fout, e.what());
+		}
+
+		slaap_tot(stop, next);
+	}
 }
 
 std::vector<SessySOC> SessyService::get_soc() const
 {
+	{
+		std::unique_lock lock(m_mutex);
+		if (m_polled)
+			return m_soc;
+	}
+
 	return read();
 }
 
+std::tuple<IntervalWaarde, IntervalWaarde, IntervalWaarde> SessyService::take_interval(std::chrono::system_clock::time_point t)
+{
+	std::unique_lock lock(m_mutex);
+	return { m_zon.take(t), m_batterij.take(t), m_laad_niveau.take(t) };
+}
+
 std::vector<SessySOC> SessyService::read() const
 {
 	auto &config = mcfp::config::instance();
@@ -77,10 +165,26 @@ std::vector<SessySOC> SessyService::read() const
 		if (ec)
 			continue;
 
-		auto rep = simple_request(url);
+		auto &metrieken = Metrieken::instance();
+		MetriekLabels labels{ { "sessy", std::to_string(sessy_nr) } };
+
+		zeep::http::reply rep;
+
+		try
+		{
+			MeetTijd meting(metrieken.histogram("energyd_sessy_poll_seconds", "Time to fetch the status of a Sessy battery", labels));
+			TraceSpan span("sessy", "fetch", "nr", sessy_nr);
+			rep = simple_request(url);
+		}
+		catch (...)
+		{
+			metrieken.teller("energyd_sessy_poll_failures_total", "Failed polls of a Sessy battery", labels).inc();
+			throw;
+		}
 
 		if (rep.get_status() != zeep::http::ok)
 		{
+			metrieken.teller("energyd_sessy_poll_failures_total", "Failed polls of a Sessy battery", labels).inc();
 			std::cerr << "Failed to fetch sessy power status for sessy " << sessy_nr << '\n';
 			continue;
 		}
@@ -26,11 +26,13 @@
 
 #pragma once
 
+#include "accumulator.hpp"
 #include "data-service.hpp"
 
 #include <boost/asio.hpp>
 
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -40,13 +42,33 @@ class SessyService
 	static SessyService &init(boost::asio::io_context &io_context);
 	static SessyService &instance();
 
+	// Stops polling, waits for a poll in progress
+	static void stop();
+
+	~SessyService();
+
 	std::vector<SessySOC> get_soc() const;
 
+	// Returns the solar power, the battery power and the state of charge
+	// integrated over all polls since the previous call
+	std::tuple<IntervalWaarde, IntervalWaarde, IntervalWaarde> take_interval(std::chrono::system_clock::time_point t);
+
   private:
 	SessyService(boost::asio::io_context &io_context);
 
+	void run(std::stop_token stop);
+
 	std::vector<SessySOC> read() const;
 
+	std::chrono::seconds m_poll_interval;
+
+	mutable std::mutex m_mutex;
+	std::vector<SessySOC> m_soc;
+	bool m_polled = false;
+	IntervalAccumulator m_zon, m_batterij, m_laad_niveau;
+
 	boost::asio::io_context &m_io_context;
+	std::jthread m_thread;
+
 	static std::unique_ptr<SessyService> s_instance;
 };
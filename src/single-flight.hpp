@@ -0,0 +1,122 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+// --------------------------------------------------------------------
+// Coalesces concurrent identical computations. The first caller for a
+// key does the work, callers arriving while it is in progress wait for
+// it and share the result, or the exception. Nothing is cached, once
+// the computation is done the next caller starts a new one.
+
+// Thrown to a caller that waited longer than the maximum for the
+// computation in progress
+class WachtenVerlopen : public std::runtime_error
+{
+  public:
+	WachtenVerlopen()
+		: std::runtime_error("Waiting for a shared result timed out")
+	{
+	}
+};
+
+template <typename Key, typename Value>
+class SingleFlight
+{
+  public:
+	using result_type = std::shared_ptr<const Value>;
+
+	// Callers waiting for the computation of another caller wait at
+	// most max_wacht, zero means no limit
+	explicit SingleFlight(std::chrono::milliseconds max_wacht = {})
+		: m_max_wacht(max_wacht)
+	{
+	}
+
+	// Returns the result of f, or of the call in progress for key. When
+	// gedeeld is not null it is set to whether the result was shared.
+	result_type voer_uit(const Key &key, const std::function<Value()> &f, bool *gedeeld = nullptr)
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (auto i = m_bezig.find(key); i != m_bezig.end())
+		{
+			auto bezig = i->second;
+			lock.unlock();
+
+			if (gedeeld)
+				*gedeeld = true;
+
+			if (m_max_wacht.count() > 0 and bezig.wait_for(m_max_wacht) != std::future_status::ready)
+				throw WachtenVerlopen();
+
+			return bezig.get();
+		}
+
+		std::promise<result_type> promise;
+		m_bezig.emplace(key, promise.get_future().share());
+
+		lock.unlock();
+
+		if (gedeeld)
+			*gedeeld = false;
+
+		try
+		{
+			auto result = std::make_shared<const Value>(f());
+			klaar(key);
+			promise.set_value(result);
+			return result;
+		}
+		catch (...)
+		{
+			klaar(key);
+			promise.set_exception(std::current_exception());
+			throw;
+		}
+	}
+
+  private:
+	void klaar(const Key &key)
+	{
+		std::unique_lock lock(m_mutex);
+		m_bezig.erase(key);
+	}
+
+	std::chrono::milliseconds m_max_wacht;
+
+	std::mutex m_mutex;
+	std::map<Key, std::shared_future<result_type>> m_bezig;
+};
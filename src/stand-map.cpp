@@ -0,0 +1,137 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "stand-map.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+// --------------------------------------------------------------------
+
+void StandMap::insert(time_point t, float stand)
+{
+	if (m_tijd.empty() or m_tijd.back() < t)
+	{
+		m_tijd.push_back(t);
+		m_stand.push_back(stand);
+	}
+	else
+	{
+		auto i = std::lower_bound(m_tijd.begin(), m_tijd.end(), t) - m_tijd.begin();
+
+		if (m_tijd[i] == t)
+			m_stand[i] = stand;
+		else
+		{
+			m_tijd.insert(m_tijd.begin() + i, t);
+			m_stand.insert(m_stand.begin() + i, stand);
+		}
+	}
+}
+
+// ub is the index of the first reading after t
+float StandMap::interpoleer(size_t ub, time_point t) const
+{
+	if (ub == m_tijd.size())
+		return m_stand.back();
+
+	if (ub == 0)
+		return m_stand.front();
+
+	auto b = ub - 1;
+
+	double d1 = (m_tijd[ub] - m_tijd[b]).count();
+	double d2 = (t - m_tijd[b]).count();
+
+	auto df = m_stand[ub] - m_stand[b];
+
+	return m_stand[b] + df * (d2 / d1);
+}
+
+float StandMap::stand(time_point t) const
+{
+	if (m_tijd.empty())
+		return 0;
+
+	return interpoleer(std::upper_bound(m_tijd.begin(), m_tijd.end(), t) - m_tijd.begin(), t);
+}
+
+std::vector<float> StandMap::standen(const std::vector<time_point> &tijden) const
+{
+	std::vector<float> result(tijden.size(), 0);
+
+	if (m_tijd.empty())
+		return result;
+
+	std::vector<size_t> volgorde(tijden.size());
+	std::iota(volgorde.begin(), volgorde.end(), 0);
+	std::sort(volgorde.begin(), volgorde.end(), [&tijden](size_t a, size_t b)
+		{ return tijden[a] < tijden[b]; });
+
+	size_t ub = 0;
+
+	for (auto i : volgorde)
+	{
+		auto t = tijden[i];
+
+		while (ub < m_tijd.size() and m_tijd[ub] <= t)
+			++ub;
+
+		result[i] = interpoleer(ub, t);
+	}
+
+	return result;
+}
+
+// --------------------------------------------------------------------
+
+size_t VerbruikBerekening::vraag(time_point t, duration periode)
+{
+	auto t1 = std::min(t, m_sm.laatste_tijd());
+	auto t2 = std::min(t - periode, t1);
+
+	m_tijden.push_back(t1);
+	m_tijden.push_back(t2);
+
+	return m_tijden.size() / 2 - 1;
+}
+
+std::vector<float> VerbruikBerekening::bereken() const
+{
+	auto standen = m_sm.standen(m_tijden);
+
+	std::vector<float> result(size(), 0);
+
+	for (size_t i = 0; i < result.size(); ++i)
+	{
+		auto t1 = m_tijden[2 * i], t2 = m_tijden[2 * i + 1];
+
+		if (t1 > t2)
+			result[i] = (24 * 60 * 60) * (standen[2 * i] - standen[2 * i + 1]) / std::chrono::floor<std::chrono::seconds>(t1 - t2).count();
+	}
+
+	return result;
+}
@@ -0,0 +1,110 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+// --------------------------------------------------------------------
+// The readings of a meter (or the sum of several meters) over time,
+// stored as two sorted arrays.
+
+class StandMap
+{
+  public:
+	using time_point = std::chrono::system_clock::time_point;
+
+	bool empty() const
+	{
+		return m_tijd.empty();
+	}
+
+	size_t size() const
+	{
+		return m_tijd.size();
+	}
+
+	time_point eerste_tijd() const
+	{
+		return m_tijd.front();
+	}
+
+	time_point laatste_tijd() const
+	{
+		return m_tijd.back();
+	}
+
+	// Adding readings in chronological order is O(1), a reading at the
+	// same time as an existing one replaces it
+	void insert(time_point t, float stand);
+
+	// Linear interpolation of the reading at time t. Before the first
+	// and after the last reading the nearest reading is returned.
+	float stand(time_point t) const;
+
+	// The same for many points in time at once, the readings are
+	// visited in a single sweep
+	std::vector<float> standen(const std::vector<time_point> &tijden) const;
+
+  private:
+	float interpoleer(size_t ub, time_point t) const;
+
+	std::vector<time_point> m_tijd;
+	std::vector<float> m_stand;
+};
+
+// --------------------------------------------------------------------
+// Collects requests for the average use per day over a period ending
+// at some point in time, and then computes all of them at once.
+
+class VerbruikBerekening
+{
+  public:
+	using time_point = StandMap::time_point;
+	using duration = std::chrono::system_clock::duration;
+
+	VerbruikBerekening(const StandMap &sm)
+		: m_sm(sm)
+	{
+	}
+
+	// Returns the index of this request in the result of bereken()
+	size_t vraag(time_point t, duration periode);
+
+	size_t size() const
+	{
+		return m_tijden.size() / 2;
+	}
+
+	std::vector<float> bereken() const;
+
+  private:
+	const StandMap &m_sm;
+
+	// pairs of begin and end time
+	std::vector<time_point> m_tijden;
+};
@@ -0,0 +1,188 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "trace.hpp"
+
+#include <mcfp/mcfp.hpp>
+
+#include <algorithm>
+
+// --------------------------------------------------------------------
+
+namespace
+{
+
+uint32_t trace_tid()
+{
+	static std::atomic<uint32_t> s_volgende{ 1 };
+	thread_local uint32_t t_tid = s_volgende.fetch_add(1, std::memory_order_relaxed);
+	return t_tid;
+}
+
+void schrijf_json_string(std::ostream &os, const std::string &s)
+{
+	os << '"';
+	for (char ch : s)
+	{
+		switch (ch)
+		{
+			case '"': os << "\\\""; break;
+			case '\\': os << "\\\\"; break;
+			case '\n': os << "\\n"; break;
+			default:
+				if (static_cast<unsigned char>(ch) >= 0x20)
+					os << ch;
+		}
+	}
+	os << '"';
+}
+
+} // namespace
+
+// --------------------------------------------------------------------
+
+std::atomic<bool> Trace::s_actief{ false };
+std::unique_ptr<Trace> Trace::s_instance;
+
+Trace &Trace::instance()
+{
+	static std::once_flag s_once;
+	std::call_once(s_once, []()
+		{ s_instance.reset(new Trace); });
+	return *s_instance;
+}
+
+Trace::Trace()
+	: m_start(std::chrono::steady_clock::now())
+{
+	auto &config = mcfp::config::instance();
+
+	m_grootte = std::max<size_t>(config.get<size_t>("trace-buffer"), 16);
+	m_ring.reset(new Slot[m_grootte]);
+
+	s_actief = config.has("trace");
+}
+
+void Trace::schrijf(const char *categorie, const char *naam, std::chrono::steady_clock::time_point begin,
+	std::chrono::steady_clock::time_point einde, const char *arg_naam, int64_t arg)
+{
+	using namespace std::chrono;
+
+	auto i = m_volgende.fetch_add(1, std::memory_order_relaxed);
+	auto &slot = m_ring[i % m_grootte];
+
+	// A seqlock, odd while the slot is being written
+	slot.seq.store(2 * i + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.categorie.store(categorie, std::memory_order_relaxed);
+	slot.naam.store(naam, std::memory_order_relaxed);
+	slot.begin.store(duration_cast<microseconds>(begin - m_start).count(), std::memory_order_relaxed);
+	slot.duur.store(duration_cast<microseconds>(einde - begin).count(), std::memory_order_relaxed);
+	slot.arg_naam.store(arg_naam, std::memory_order_relaxed);
+	slot.arg.store(arg, std::memory_order_relaxed);
+	slot.tid.store(trace_tid(), std::memory_order_relaxed);
+
+	slot.seq.store(2 * i + 2, std::memory_order_release);
+}
+
+void Trace::thread_naam(const std::string &naam)
+{
+	std::unique_lock lock(m_mutex);
+	m_thread_namen[trace_tid()] = naam;
+}
+
+void Trace::dump(std::ostream &os) const
+{
+	struct Span
+	{
+		const char *categorie, *naam, *arg_naam;
+		int64_t begin, duur, arg;
+		uint32_t tid;
+	};
+
+	std::vector<Span> spans;
+	spans.reserve(m_grootte);
+
+	for (size_t i = 0; i < m_grootte; ++i)
+	{
+		auto &slot = m_ring[i];
+
+		auto seq = slot.seq.load(std::memory_order_acquire);
+		if (seq == 0 or seq % 2 == 1)
+			continue;
+
+		Span span{
+			slot.categorie.load(std::memory_order_relaxed),
+			slot.naam.load(std::memory_order_relaxed),
+			slot.arg_naam.load(std::memory_order_relaxed),
+			slot.begin.load(std::memory_order_relaxed),
+			slot.duur.load(std::memory_order_relaxed),
+			slot.arg.load(std::memory_order_relaxed),
+			slot.tid.load(std::memory_order_relaxed)
+		};
+
+		// skip the slot if it was overwritten while reading it
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) != seq)
+			continue;
+
+		spans.push_back(span);
+	}
+
+	std::sort(spans.begin(), spans.end(), [](const Span &a, const Span &b)
+		{ return a.begin < b.begin; });
+
+	os << R"({"displayTimeUnit":"ms","traceEvents":[)";
+
+	bool eerste = true;
+
+	{
+		std::unique_lock lock(m_mutex);
+		for (auto &[tid, naam] : m_thread_namen)
+		{
+			os << (eerste ? "" : ",") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << tid << R"(,"args":{"name":)";
+			schrijf_json_string(os, naam);
+			os << "}}";
+			eerste = false;
+		}
+	}
+
+	for (auto &span : spans)
+	{
+		os << (eerste ? "" : ",") << R"({"name":")" << span.naam << R"(","cat":")" << span.categorie
+		   << R"(","ph":"X","pid":1,"tid":)" << span.tid << R"(,"ts":)" << span.begin << R"(,"dur":)" << span.duur;
+
+		if (span.arg_naam)
+			os << R"(,"args":{")" << span.arg_naam << R"(":)" << span.arg << '}';
+
+		os << '}';
+		eerste = false;
+	}
+
+	os << "]}";
+}
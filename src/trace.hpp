@@ -0,0 +1,132 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------------------
+// Optional tracing of the collector pipeline. Spans are written into a
+// fixed size ring in memory without taking locks, the oldest spans are
+// overwritten. The ring can be dumped at any time in the Chrome trace
+// event format, to be loaded in chrome://tracing or ui.perfetto.dev.
+// When tracing is off a span costs a single relaxed load.
+
+class Trace
+{
+  public:
+	static Trace &instance();
+
+	static bool actief()
+	{
+		return s_actief.load(std::memory_order_relaxed);
+	}
+
+	// categorie, naam and arg_naam must be string literals, the argument
+	// is only written when arg_naam is not null.
+	void schrijf(const char *categorie, const char *naam, std::chrono::steady_clock::time_point begin,
+		std::chrono::steady_clock::time_point einde, const char *arg_naam, int64_t arg);
+
+	// Name the calling thread in the trace
+	void thread_naam(const std::string &naam);
+
+	// Write the current contents of the ring as Chrome trace event JSON
+	void dump(std::ostream &os) const;
+
+  private:
+	Trace();
+
+	struct Slot
+	{
+		std::atomic<uint64_t> seq{ 0 };
+		std::atomic<const char *> categorie{ nullptr };
+		std::atomic<const char *> naam{ nullptr };
+		std::atomic<const char *> arg_naam{ nullptr };
+		std::atomic<int64_t> begin{ 0 }, duur{ 0 }, arg{ 0 };
+		std::atomic<uint32_t> tid{ 0 };
+	};
+
+	std::unique_ptr<Slot[]> m_ring;
+	size_t m_grootte;
+	std::atomic<uint64_t> m_volgende{ 0 };
+	std::chrono::steady_clock::time_point m_start;
+
+	mutable std::mutex m_mutex;
+	std::map<uint32_t, std::string> m_thread_namen;
+
+	static std::atomic<bool> s_actief;
+	static std::unique_ptr<Trace> s_instance;
+};
+
+// Records the time from construction to destruction as a span
+
+class TraceSpan
+{
+  public:
+	TraceSpan(const char *categorie, const char *naam, const char *arg_naam = nullptr, int64_t arg = 0)
+	{
+		if (Trace::actief())
+		{
+			m_categorie = categorie;
+			m_naam = naam;
+			m_arg_naam = arg_naam;
+			m_arg = arg;
+			m_begin = std::chrono::steady_clock::now();
+		}
+	}
+
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+
+	~TraceSpan()
+	{
+		if (m_naam)
+			Trace::instance().schrijf(m_categorie, m_naam, m_begin, std::chrono::steady_clock::now(), m_arg_naam, m_arg);
+	}
+
+	// Change the argument, for values only known at the end of the span
+	void set_arg(const char *arg_naam, int64_t arg)
+	{
+		m_arg_naam = arg_naam;
+		m_arg = arg;
+	}
+
+  private:
+	const char *m_categorie = nullptr;
+	const char *m_naam = nullptr;
+	const char *m_arg_naam = nullptr;
+	int64_t m_arg = 0;
+	std::chrono::steady_clock::time_point m_begin;
+};
@@ -0,0 +1,144 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "metrics.hpp"
+#include "uitvoerder.hpp"
+
+// --------------------------------------------------------------------
+
+std::unique_ptr<Uitvoerder> Uitvoerder::s_instance;
+
+void Uitvoerder::init(size_t threads, size_t wachtrij)
+{
+	s_instance.reset(new Uitvoerder(threads, wachtrij));
+}
+
+Uitvoerder &Uitvoerder::instance()
+{
+	if (not s_instance)
+		throw std::logic_error("No instance yet!");
+
+	return *s_instance;
+}
+
+Uitvoerder::Uitvoerder(size_t threads, size_t wachtrij)
+	: m_max_wachtrij(wachtrij)
+{
+	threads = std::max<size_t>(threads, 1);
+
+	for (size_t i = 0; i < threads; ++i)
+		m_threads.emplace_back(std::bind(&Uitvoerder::run, this));
+
+	auto &metrieken = Metrieken::instance();
+
+	metrieken.meter("energyd_executor_threads", "Number of threads for blocking work",
+		[threads]()
+		{ return static_cast<double>(threads); });
+	metrieken.meter("energyd_executor_busy", "Threads currently running blocking work",
+		[this]()
+		{ return static_cast<double>(get_bezig()); });
+	metrieken.meter("energyd_executor_queued", "Blocking jobs waiting for a thread",
+		[this]()
+		{ return static_cast<double>(get_wachtend()); });
+}
+
+Uitvoerder::~Uitvoerder()
+{
+	{
+		std::unique_lock lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_cv.notify_all();
+
+	for (auto &t : m_threads)
+		t.join();
+}
+
+size_t Uitvoerder::get_bezig() const
+{
+	std::unique_lock lock(m_mutex);
+	return m_bezig;
+}
+
+size_t Uitvoerder::get_wachtend() const
+{
+	std::unique_lock lock(m_mutex);
+	return m_wachtrij.size();
+}
+
+void Uitvoerder::plaats(std::function<void()> job)
+{
+	static auto &s_geweigerd = Metrieken::instance().teller("energyd_executor_rejected_total",
+		"Blocking jobs refused because all threads were busy and the queue was full");
+
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (m_bezig + m_wachtrij.size() >= m_threads.size() + m_max_wachtrij)
+		{
+			lock.unlock();
+			s_geweigerd.inc();
+			throw Verzadigd();
+		}
+
+		m_wachtrij.emplace_back(Job{ std::move(job), std::chrono::steady_clock::now() });
+	}
+
+	m_cv.notify_one();
+}
+
+void Uitvoerder::run()
+{
+	static auto &s_wacht_tijd = Metrieken::instance().histogram("energyd_executor_wait_seconds",
+		"Time blocking jobs spent waiting for a thread");
+
+	for (;;)
+	{
+		Job job;
+
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [this]()
+				{ return m_stop or not m_wachtrij.empty(); });
+
+			if (m_wachtrij.empty())
+				break;
+
+			job = std::move(m_wachtrij.front());
+			m_wachtrij.pop_front();
+			++m_bezig;
+		}
+
+		s_wacht_tijd.observe(std::chrono::steady_clock::now() - job.geplaatst);
+
+		job.werk();
+
+		std::unique_lock lock(m_mutex);
+		--m_bezig;
+	}
+}
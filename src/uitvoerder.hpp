@@ -0,0 +1,111 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2023 Maarten L. Hekkelman
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// --------------------------------------------------------------------
+// A bounded pool of threads for blocking work like database queries.
+// The server threads hand their blocking work to this pool and wait
+// for it. Since the number of running and queued jobs is limited, a
+// burst of slow requests occupies at most that many server threads,
+// the rest stay available for static files and metrics. Work that
+// does not fit is refused with a Verzadigd exception.
+
+class Verzadigd : public std::runtime_error
+{
+  public:
+	Verzadigd()
+		: std::runtime_error("Te veel werk tegelijk, probeer het later nog eens")
+	{
+	}
+};
+
+class Uitvoerder
+{
+  public:
+	static void init(size_t threads, size_t wachtrij);
+	static Uitvoerder &instance();
+
+	~Uitvoerder();
+
+	// Runs f on one of the threads of the pool and returns its result,
+	// or rethrows its exception. Throws Verzadigd when all threads are
+	// busy and the queue is full.
+	template <typename F>
+	std::invoke_result_t<F> voer_uit(F &&f)
+	{
+		using R = std::invoke_result_t<F>;
+
+		std::packaged_task<R()> taak(std::forward<F>(f));
+		auto result = taak.get_future();
+
+		plaats([&taak]()
+			{ taak(); });
+
+		return result.get();
+	}
+
+	size_t get_bezig() const;
+	size_t get_wachtend() const;
+
+  private:
+	Uitvoerder(size_t threads, size_t wachtrij);
+
+	// Queues job, the caller makes sure it outlives its execution
+	void plaats(std::function<void()> job);
+
+	void run();
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	struct Job
+	{
+		std::function<void()> werk;
+		std::chrono::steady_clock::time_point geplaatst;
+	};
+
+	std::deque<Job> m_wachtrij;
+	size_t m_max_wachtrij;
+	size_t m_bezig = 0;
+	bool m_stop = false;
+	std::vector<std::thread> m_threads;
+
+	static std::unique_ptr<Uitvoerder> s_instance;
+};
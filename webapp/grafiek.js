@@ -1,4 +1,5 @@
 import * as d3 from 'd3';
+import { uitKolommen } from './kolommen';
 
 let grafiek;
 
@@ -129,14 +130,14 @@ class Grafiek {
 		Array.from(document.getElementsByClassName("grafiek-naam"))
 			.forEach(span => span.textContent = grafiekNaam);
 
-		fetch(`ajax/data/${keuze}/${this.aggrType}`, {
+		fetch(`ajax/data/${keuze}/${this.aggrType}?formaat=kolommen`, {
 			credentials: "include",
 			headers: {
 				'Accept': 'application/json'
 			}
 		}).then(async response => {
 			if (response.ok)
-				return response.json();
+				return uitKolommen(await response.json(), 'd', false);
 
 			const error = await response.json();
 			console.log(error);
@@ -0,0 +1,29 @@
+// Converts a reply in the columnar format (formaat=kolommen) back into
+// an array of objects. Slot i is at start + i * stap seconds, slots
+// without values are skipped. The time is stored in tijdVeld, as a
+// Date when asDate is set, otherwise as an ISO date string.
+
+export function uitKolommen(data, tijdVeld, asDate = true) {
+	const result = [];
+
+	if (data.aantal === 0)
+		return result;
+
+	const start = new Date(data.start).getTime();
+	const kolommen = Object.keys(data).filter(k => Array.isArray(data[k]));
+
+	for (let i = 0; i < data.aantal; ++i) {
+		if (kolommen.every(k => data[k][i] === null))
+			continue;
+
+		const tijd = new Date(start + i * data.stap * 1000);
+		const d = { [tijdVeld]: asDate ? tijd : tijd.toISOString().substring(0, 10) };
+
+		for (const k of kolommen)
+			d[k] = data[k][i];
+
+		result.push(d);
+	}
+
+	return result;
+}
@@ -112,22 +112,117 @@ class OpnameEditor {
 	}
 }
 
-window.addEventListener("load", () => {
+// The table initially contains only the most recent opnames, older
+// ones are fetched a page at a time using the datum of the last row.
 
-	const editor = new OpnameEditor();
+class OpnameLijst {
+
+	constructor(editor) {
+		this.editor = editor;
+		this.table = document.getElementById('opname-tabel');
+		this.tellers = Array.from(this.table.tHead.rows[0].cells)
+			.filter(th => th.dataset.id !== undefined)
+			.map(th => th.dataset.id);
+
+		Array.from(this.table.tBodies[0].rows)
+			.forEach(tr => this.connect(tr));
+
+		this.btn = document.getElementById('meer-opnames-btn');
+		if (this.btn)
+			this.btn.addEventListener('click', () => this.loadMore());
+	}
+
+	connect(tr) {
+		tr.querySelector('.edit-opname-btn')
+			.addEventListener("click", (e) => this.editor.editOpname(e.currentTarget.dataset.id));
+
+		const del = tr.querySelector('.delete-opname-btn');
+		del.addEventListener("click", () => this.editor.deleteOpname(del.dataset.id, del.dataset.name));
+
+		tr.addEventListener("dblclick", () => this.editor.editOpname(tr.dataset.id));
+	}
 
-	Array.from(document.getElementsByClassName("edit-opname-btn"))
-		.forEach(btn => btn.addEventListener("click", () => editor.editOpname(btn.dataset.id)));
+	loadMore() {
+		const rows = this.table.tBodies[0].rows;
+		const laatste = rows.length > 0 ? rows[rows.length - 1] : null;
 
-	Array.from(document.getElementsByClassName("delete-opname-btn"))
-		.forEach(btn => btn.addEventListener("click", () => {
-			return editor.deleteOpname(btn.dataset.id, btn.dataset.name);
-		}));
+		const url = laatste
+			? `ajax/opname?voor=${encodeURIComponent(laatste.dataset.datum)}&voor_id=${encodeURIComponent(laatste.dataset.id)}`
+			: 'ajax/opname';
+
+		this.btn.disabled = true;
+
+		fetch(url, { credentials: "include", method: "get" })
+			.then(async response => {
+				if (response.ok)
+					return response.json();
+
+				const error = await response.json();
+				console.log(error);
+				throw error.message;
+			})
+			.then(opnames => {
+				opnames.forEach(opname => this.addRow(opname));
 
-	Array.from(document.getElementById('opname-tabel').tBodies[0].rows)
-		.forEach(tr => {
-			tr.addEventListener("dblclick", () => {
-				editor.editOpname(tr.dataset.id);
+				if (opnames.length === 0)
+					this.btn.parentElement.remove();
+				else
+					this.btn.disabled = false;
 			})
+			.catch(err => alert(err));
+	}
+
+	addRow(opname) {
+		const tr = this.table.tBodies[0].insertRow();
+		tr.dataset.id = opname.id;
+		tr.dataset.datum = opname.datum;
+
+		const datum = new Date(opname.datum);
+		const td = tr.insertCell();
+
+		const groot = document.createElement('span');
+		groot.classList.add('datum-groot');
+		groot.textContent = datum.toLocaleString('nl-NL', {
+			timeZone: 'UTC', day: '2-digit', month: 'long', year: 'numeric', hour: '2-digit', minute: '2-digit'
 		});
+		td.appendChild(groot);
+
+		const klein = document.createElement('span');
+		klein.classList.add('datum-klein');
+		klein.textContent = datum.toLocaleDateString('nl-NL', {
+			timeZone: 'UTC', day: '2-digit', month: '2-digit', year: '2-digit'
+		});
+		td.appendChild(klein);
+
+		for (const id of this.tellers) {
+			const cell = tr.insertCell();
+			cell.style.textAlign = 'right';
+
+			const stand = opname.standen[id];
+			if (stand !== undefined) {
+				const decimalen = id === '1' ? 3 : 2;
+				cell.textContent = stand.toLocaleString('nl-NL', { minimumFractionDigits: decimalen, maximumFractionDigits: decimalen });
+			}
+		}
+
+		const edit = tr.insertCell();
+		edit.classList.add('edit-opname-btn');
+		edit.dataset.id = opname.id;
+		edit.innerHTML = '<i class="bi bi-pencil-square"></i>';
+
+		const del = tr.insertCell();
+		del.classList.add('delete-opname-btn');
+		del.dataset.id = opname.id;
+		del.dataset.name = opname.datum;
+		del.innerHTML = '<i class="bi bi-trash"></i>';
+
+		this.connect(tr);
+	}
+}
+
+window.addEventListener("load", () => {
+
+	const editor = new OpnameEditor();
+
+	new OpnameLijst(editor);
 });
@@ -1,7 +1,13 @@
 import * as d3 from 'd3';
+import { uitKolommen } from './kolommen';
 
 let grafiek;
 
+const resolutie = 15;
+
+// Seconds between two updates of the graph of today
+const verversInterval = 60;
+
 class Grafiek {
 	constructor() {
 
@@ -92,29 +98,63 @@ class Grafiek {
 		this.plotData.selectAll("*").remove();
 
 		const datum = new Date(document.getElementById("graph-date").value);
-		const start = d3.timeDay.floor(datum);
-		const stop = d3.timeDay.ceil(datum);
 
 		if (this.width < 100)
 			return;
-		
-		const resolutie = 15;
 
-		const data = await fetch(`ajax/grafiek/${datum.toISOString().substring(0, 10)}?resolutie=${resolutie}`)
+		this.datum = datum.toISOString().substring(0, 10);
+		this.data = await this.haalData(this.datum);
+
+		this.tekenGrafiek(datum);
+	}
+
+	// Fetch only the points since the last one shown and merge them,
+	// the last point is replaced since its interval may have grown.
+	async verversGrafiek() {
+
+		const datum = new Date(document.getElementById("graph-date").value);
+
+		if (this.data === undefined || this.data.length === 0 ||
+			this.datum !== datum.toISOString().substring(0, 10) ||
+			this.datum !== new Date().toISOString().substring(0, 10))
+			return;
+
+		const laatste = this.data[this.data.length - 1].tijd;
+		const nieuw = await this.haalData(this.datum, laatste);
+
+		if (nieuw.length === 0)
+			return;
+
+		this.data = this.data.filter(d => d.tijd < nieuw[0].tijd).concat(nieuw);
+
+		this.plotData.selectAll("*").remove();
+		this.tekenGrafiek(datum);
+	}
+
+	async haalData(datum, sinds) {
+		let url = `ajax/grafiek/${datum}?resolutie=${resolutie}&formaat=kolommen`;
+		if (sinds !== undefined)
+			url += `&since=${sinds.toISOString()}`;
+
+		return fetch(url)
 			.then(async r => {
 				if (r.ok)
-					return r.json();
+					return uitKolommen(await r.json(), 'tijd');
 
 				const error = await r.json();
 				throw error.message;
 			});
+	}
+
+	tekenGrafiek(datum) {
 
-		console.log(data);
+		const data = this.data;
+		const start = d3.timeDay.floor(datum);
+		const stop = d3.timeDay.ceil(datum);
 
 		let minE = 0, maxE = 0;
 
 		data.forEach(d => {
-			d.tijd = new Date(d.tijd);
 			minE = Math.min(minE, d.zon, -d.batterij, -d.verbruik, d.levering, d.laad_niveau);
 			maxE = Math.max(maxE, d.zon, -d.batterij, -d.verbruik, d.levering, d.laad_niveau);
 		});
@@ -186,6 +226,8 @@ class Grafiek {
 window.addEventListener("load", () => {
 	grafiek = new Grafiek();
 	grafiek.laadGrafiek();
+
+	setInterval(() => grafiek.verversGrafiek().catch(err => console.log(err)), verversInterval * 1000);
 });
 
 window.addEventListener("resize", () => {
@@ -4,9 +4,48 @@ const webpack = require('webpack');
 const TerserPlugin = require('terser-webpack-plugin');
 const UglifyJsPlugin = require('uglifyjs-webpack-plugin');
 const path = require('path');
+const fs = require('fs');
+const zlib = require('zlib');
 
 const SCRIPTS = path.resolve(__dirname, "webapp/");
 const DEST = path.resolve(__dirname, "docroot/scripts");
+const DOCROOT = path.resolve(__dirname, "docroot");
+
+// All output files carry a content hash in their name, so the server can
+// tell browsers to cache them forever. This plugin writes manifest.json,
+// mapping the plain names to the hashed ones per directory, and next to
+// each script and style sheet a gzip and brotli compressed copy that the
+// server sends as is.
+
+class AssetsPlugin {
+	apply(compiler) {
+		compiler.hooks.afterEmit.tap('AssetsPlugin', compilation => {
+			const manifest = { scripts: {}, css: {}, fonts: {} };
+
+			for (const asset of compilation.getAssets()) {
+				const file = path.resolve(DEST, asset.name);
+				const dir = path.basename(path.dirname(file));
+				const naam = path.basename(file);
+
+				const m = naam.match(/^(.+)\.[0-9a-f]{8}(\.[a-z0-9]+)$/);
+				if (m === null || manifest[dir] === undefined)
+					continue;
+
+				manifest[dir][m[1] + m[2]] = naam;
+
+				if (m[2] === '.js' || m[2] === '.css') {
+					const data = asset.source.buffer();
+					fs.writeFileSync(file + '.gz', zlib.gzipSync(data, { level: 9 }));
+					fs.writeFileSync(file + '.br', zlib.brotliCompressSync(data, {
+						params: { [zlib.constants.BROTLI_PARAM_QUALITY]: zlib.constants.BROTLI_MAX_QUALITY }
+					}));
+				}
+			}
+
+			fs.writeFileSync(path.resolve(DOCROOT, "manifest.json"), JSON.stringify(manifest, null, '\t'));
+		});
+	}
+}
 
 module.exports = (env) => {
 
@@ -23,6 +62,7 @@ module.exports = (env) => {
 
 		output: {
 			path: DEST,
+			filename: "[name].[contenthash:8].js",
 			clean: true
 		},
 
@@ -54,7 +94,7 @@ module.exports = (env) => {
 					include: path.resolve(__dirname, './node_modules/bootstrap-icons/font/fonts'),
 					type: 'asset/resource',
 					generator: {
-						filename: '../fonts/[name][ext]'
+						filename: '../fonts/[name].[contenthash:8][ext]'
 					}
 				}
 			]
@@ -66,15 +106,17 @@ module.exports = (env) => {
 
 		plugins: [
 			new MiniCssExtractPlugin({
-				filename: "../css/[name].css"
+				filename: "../css/[name].[contenthash:8].css"
 			}),
 			new CleanWebpackPlugin({
 				verbose: true,
+				dangerouslyAllowCleanPatternsOutsideProject: true,
 				cleanOnceBeforeBuildPatterns: [
-					path.resolve(__dirname, 'scripts'),
-					path.resolve(__dirname, 'fonts')
+					path.resolve(DOCROOT, 'css'),
+					path.resolve(DOCROOT, 'fonts')
 				]
-			})],
+			}),
+			new AssetsPlugin()],
 
 		optimization: { minimizer: [] }
 	};